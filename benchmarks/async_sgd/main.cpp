@@ -0,0 +1,92 @@
+#include <mlp/mlp.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../tests/test_util.h"
+
+// Compares synchronous Train against Hogwild TrainAsync on a synthetic
+// MNIST-shaped classification problem.
+//
+// Usage: mlp-async-sgd-benchmark [num_of_samples] [num_of_iterations]
+
+enum { INPUT_SIZE = 28 * 28, NUM_OF_CLASSES = 10 };
+
+mlp::MultilayerPerceptron MakeModel() {
+  // same initial weights for every run
+  return test_util::MakeModel({INPUT_SIZE, 16, 16, NUM_OF_CLASSES}, 42);
+}
+
+void Report(const std::string& name, const mlp::MultilayerPerceptron& model,
+            const mlp::DataSet& input, const mlp::DataSet& output,
+            size_t processed, double seconds) {
+  mlp::LossFunction loss = mlp::LossFunctionsList().GetByName("square");
+
+  double total_loss = 0;
+  size_t correct_answers = 0;
+  for (size_t i = 0; i < input.size(); ++i) {
+    mlp::Vector r = model.Calculate(mlp::to_Vector(input[i]));
+    mlp::Vector y = mlp::to_Vector(output[i]);
+    total_loss += loss.CalculateLoss(r, y);
+
+    ssize_t chosen, expected;
+    r.maxCoeff(&chosen);
+    y.maxCoeff(&expected);
+    correct_answers += chosen == expected;
+  }
+
+  double size = static_cast<double>(input.size());
+  std::cout << std::left << std::setw(18) << name << std::right
+            << std::setw(14) << std::fixed << std::setprecision(0)
+            << static_cast<double>(processed) / seconds << std::setw(12)
+            << std::setprecision(5) << total_loss / size << std::setw(11)
+            << std::setprecision(2)
+            << static_cast<double>(correct_answers) / size * 100 << "%"
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  size_t num_of_samples = argc > 1 ? std::stoul(argv[1]) : 20000;
+  size_t num_of_iterations = argc > 2 ? std::stoul(argv[2]) : 3;
+
+  mlp::DataSet input, output;
+  test_util::MakePixelDataSet(num_of_samples, INPUT_SIZE, NUM_OF_CLASSES, 2023,
+                              input, output);
+
+  size_t processed = num_of_samples * num_of_iterations;
+
+  std::cout << std::left << std::setw(18) << "mode" << std::right
+            << std::setw(14) << "samples/sec" << std::setw(12) << "loss"
+            << std::setw(12) << "accuracy" << std::endl;
+
+  {
+    mlp::MultilayerPerceptron model = MakeModel();
+    auto start = std::chrono::steady_clock::now();
+    model.Train(num_of_iterations, input, output);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    Report("sync", model, input, output, processed, elapsed.count());
+  }
+
+  for (size_t max_staleness : {0, 4}) {
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+      mlp::AsyncTrainingOptions options;
+      options.num_of_threads = threads;
+      options.local_batch_size = 8;
+      options.max_staleness = max_staleness;
+
+      mlp::MultilayerPerceptron model = MakeModel();
+      auto start = std::chrono::steady_clock::now();
+      model.TrainAsync(num_of_iterations, input, output, options);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      std::string name = (max_staleness == 0 ? "hogwild x" : "ssp(4) x") +
+                         std::to_string(threads);
+      Report(name, model, input, output, processed, elapsed.count());
+    }
+  }
+}
@@ -0,0 +1,355 @@
+#include <mlp/mlp.h>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The full pipeline on MNIST-shaped synthetic IDX files: load -> train ->
+// save -> load -> evaluate. Every phase runs once untimed to warm up, then
+// --repeats times and until --min-seconds passed; the JSON has the median wall
+// time and the resident memory before and after every phase, the throughput
+// of the median times and the accuracy. With --baseline the run fails when a
+// throughput drops by more than --threshold against the stored JSON of an
+// earlier run.
+//
+// Usage: mlp-end-to-end-benchmark [--train-size N] [--test-size N]
+//                                 [--epochs N] [--repeats N]
+//                                 [--min-seconds SECONDS] [--dir DIR]
+//                                 [--output FILE] [--baseline FILE]
+//                                 [--threshold FRACTION]
+
+enum { IMAGE_SIDE = 28, NUM_OF_CLASSES = 10 };
+
+struct Options {
+  size_t train_size = 20000;
+  size_t test_size = 5000;
+  size_t epochs = 3;
+  size_t repeats = 5;
+  double min_seconds = 0.0;
+  std::string directory =
+      (std::filesystem::temp_directory_path() / "mlp-end-to-end").string();
+  std::string output;
+  std::string baseline;
+  double threshold = 0.1;
+};
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string name = argv[i];
+    std::string value = argv[i + 1];
+    if (name == "--train-size") {
+      options.train_size = std::stoul(value);
+    } else if (name == "--test-size") {
+      options.test_size = std::stoul(value);
+    } else if (name == "--epochs") {
+      options.epochs = std::stoul(value);
+    } else if (name == "--repeats") {
+      options.repeats = std::max<size_t>(1, std::stoul(value));
+    } else if (name == "--min-seconds") {
+      options.min_seconds = std::stod(value);
+    } else if (name == "--dir") {
+      options.directory = value;
+    } else if (name == "--output") {
+      options.output = value;
+    } else if (name == "--baseline") {
+      options.baseline = value;
+    } else if (name == "--threshold") {
+      options.threshold = std::stod(value);
+    } else {
+      return false;
+    }
+  }
+  return argc % 2 == 1;
+}
+
+void WriteInt32(std::ostream& out, int32_t x) {
+  // IDX stores integers in big endian
+  uint32_t u = static_cast<uint32_t>(x);
+  char bytes[4] = {static_cast<char>(u >> 24), static_cast<char>(u >> 16),
+                   static_cast<char>(u >> 8), static_cast<char>(u)};
+  out.write(bytes, sizeof(bytes));
+}
+
+// Noisy copies of one random stroke pattern per class, the same for every
+// run. The training and the test set differ only in the noise.
+bool WriteSyntheticIdx(const std::string& images_path,
+                       const std::string& labels_path, size_t size,
+                       unsigned seed) {
+  const size_t image_size = IMAGE_SIDE * IMAGE_SIDE;
+
+  std::mt19937 prototype_gen(2023);
+  std::uniform_real_distribution<double> pixel(0.0, 1.0);
+  std::vector<std::vector<double>> prototypes(NUM_OF_CLASSES);
+  for (auto& prototype : prototypes) {
+    prototype.resize(image_size);
+    for (auto& p : prototype) {
+      p = pixel(prototype_gen) < 0.2 ? pixel(prototype_gen) : 0.0;
+    }
+  }
+
+  std::ofstream images(images_path, std::ios::binary);
+  std::ofstream labels(labels_path, std::ios::binary);
+  WriteInt32(images, mlp::IDX_MAGIC_NUMBER_IMAGES);
+  WriteInt32(images, static_cast<int32_t>(size));
+  WriteInt32(images, IMAGE_SIDE);
+  WriteInt32(images, IMAGE_SIDE);
+  WriteInt32(labels, mlp::IDX_MAGIC_NUMBER_LABELS);
+  WriteInt32(labels, static_cast<int32_t>(size));
+
+  std::mt19937 gen(seed);
+  std::normal_distribution<double> noise(0.0, 0.2);
+  std::vector<char> image(image_size);
+  for (size_t i = 0; i < size; ++i) {
+    size_t label = gen() % NUM_OF_CLASSES;
+    for (size_t j = 0; j < image_size; ++j) {
+      double p = prototypes[label][j];
+      // the background stays zero, as in MNIST
+      if (p > 0.0) {
+        p = std::min(1.0, std::max(0.0, p + noise(gen)));
+      }
+      image[j] = static_cast<char>(static_cast<uint8_t>(p * 255.0 + 0.5));
+    }
+    images.write(image.data(), static_cast<std::streamsize>(image.size()));
+    labels.put(static_cast<char>(label));
+  }
+  return static_cast<bool>(images) && static_cast<bool>(labels);
+}
+
+// the high-water mark of the whole process, it never goes down
+double GetProcessPeakRssMb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+
+// resident memory right now, or -1 where /proc isn't available
+double GetCurrentRssMb() {
+  std::ifstream statm("/proc/self/statm");
+  size_t size = 0, resident = 0;
+  if (!(statm >> size >> resident)) {
+    return -1.0;
+  }
+  return static_cast<double>(resident) *
+         static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+}
+
+double Median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  size_t middle = values.size() / 2;
+  return values.size() % 2 == 1
+             ? values[middle]
+             : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+class PhaseTimer {
+ public:
+  PhaseTimer(size_t repeats, double min_seconds)
+      : _repeats(repeats), _min_seconds(min_seconds) {
+    _json << std::fixed << std::setprecision(3);
+  }
+
+  // Runs phase once to warm up, then repeats times and until min_seconds
+  // passed. Appends the median wall time and the resident memory before the
+  // warmup and after the last run to the JSON and returns the median.
+  double Measure(const std::string& name, const std::function<void()>& phase) {
+    double rss_before = GetCurrentRssMb();
+    phase();
+
+    std::vector<double> seconds;
+    double total = 0.0;
+    while (seconds.size() < _repeats || total < _min_seconds) {
+      auto start = std::chrono::steady_clock::now();
+      phase();
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      seconds.push_back(elapsed.count());
+      total += elapsed.count();
+    }
+
+    double median = Median(seconds);
+    _json << (_json.tellp() > 0 ? ",\n" : "") << "    \"" << name
+          << "\": {\"seconds\": " << std::setprecision(6) << median
+          << std::setprecision(3) << ", \"runs\": " << seconds.size()
+          << ", \"rss_before_mb\": " << rss_before
+          << ", \"rss_after_mb\": " << GetCurrentRssMb() << "}";
+    return median;
+  }
+
+  std::string GetJson() const {
+    return _json.str();
+  }
+
+ private:
+  size_t _repeats;
+  double _min_seconds;
+  std::ostringstream _json;
+};
+
+// the number after "key": in a flat JSON text, or -1
+double FindNumber(const std::string& json, const std::string& key) {
+  size_t pos = json.find("\"" + key + "\"");
+  if (pos == std::string::npos) {
+    return -1.0;
+  }
+  pos = json.find(':', pos);
+  if (pos == std::string::npos) {
+    return -1.0;
+  }
+  return std::strtod(json.c_str() + pos + 1, nullptr);
+}
+
+// true when no throughput dropped by more than threshold
+bool CompareWithBaseline(const std::string& json, const std::string& path,
+                         double threshold) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Can't read baseline " << path << std::endl;
+    return false;
+  }
+  std::stringstream baseline;
+  baseline << in.rdbuf();
+
+  bool ok = true;
+  for (const char* key : {"train_samples_per_sec", "eval_samples_per_sec"}) {
+    double expected = FindNumber(baseline.str(), key);
+    double actual = FindNumber(json, key);
+    if (expected <= 0.0) {
+      std::cerr << key << ": missing in the baseline" << std::endl;
+      ok = false;
+      continue;
+    }
+
+    double change = actual / expected - 1.0;
+    bool regressed = change < -threshold;
+    std::cerr << std::fixed << std::setprecision(1) << key << ": "
+              << actual << " vs " << expected << " (" << std::showpos
+              << change * 100 << std::noshowpos << "%)"
+              << (regressed ? " REGRESSION" : "") << std::endl;
+    ok = ok && !regressed;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--train-size N] [--test-size N] [--epochs N]"
+                 " [--repeats N] [--min-seconds SECONDS] [--dir DIR]"
+                 " [--output FILE] [--baseline FILE] [--threshold FRACTION]"
+              << std::endl;
+    return 2;
+  }
+
+  std::filesystem::create_directories(options.directory);
+  std::filesystem::path directory(options.directory);
+  std::string train_images = (directory / "train-images.idx3-ubyte").string();
+  std::string train_labels = (directory / "train-labels.idx1-ubyte").string();
+  std::string test_images = (directory / "t10k-images.idx3-ubyte").string();
+  std::string test_labels = (directory / "t10k-labels.idx1-ubyte").string();
+  std::string model_path = (directory / "model").string();
+
+  if (!WriteSyntheticIdx(train_images, train_labels, options.train_size, 1) ||
+      !WriteSyntheticIdx(test_images, test_labels, options.test_size, 2)) {
+    std::cerr << "Can't write " << options.directory << std::endl;
+    return 2;
+  }
+
+  PhaseTimer timer(options.repeats, options.min_seconds);
+
+  mlp::FeatureBatch<uint8_t> x_train, x_test;
+  mlp::DataSet y_train;
+  std::vector<uint8_t> y_test;
+  timer.Measure("load_data", [&] {
+    x_train = mlp::ReadIdxImagesRaw(train_images);
+    y_train =
+        mlp::LabelsToDataSet(mlp::ReadIdxLabels(train_labels), NUM_OF_CLASSES);
+    x_test = mlp::ReadIdxImagesRaw(test_images);
+    y_test = mlp::ReadIdxLabels(test_labels);
+  });
+
+  mlp::ActivationFunctionsList act_funcs;
+  mlp::LossFunctionsList loss_funcs;
+
+  // every run trains the same initial model
+  mlp::MultilayerPerceptron model;
+  double train_seconds = timer.Measure("train", [&] {
+    std::srand(42);
+    model = mlp::MultilayerPerceptron(
+        {IMAGE_SIDE * IMAGE_SIDE, 16, 16, NUM_OF_CLASSES},
+        {act_funcs.GetByName("relu"), act_funcs.GetByName("relu"),
+         act_funcs.GetByName("softmax")},
+        loss_funcs.GetByName("square"));
+    model.SetInputNormalization(
+        mlp::Vector::Constant(IMAGE_SIDE * IMAGE_SIDE, 1.0 / 255.0),
+        mlp::Vector::Zero(IMAGE_SIDE * IMAGE_SIDE));
+    model.Train(options.epochs, x_train, y_train);
+  });
+
+  timer.Measure("save_model", [&] { model.SaveModel(model_path); });
+
+  mlp::MultilayerPerceptron loaded;
+  timer.Measure("load_model", [&] {
+    loaded = mlp::MultilayerPerceptron();
+    loaded.LoadModel(model_path, act_funcs, loss_funcs);
+  });
+
+  size_t correct = 0;
+  double eval_seconds = timer.Measure("evaluate", [&] {
+    correct = 0;
+    for (size_t i = 0; i < x_test.size(); ++i) {
+      mlp::Vector r = loaded.Calculate(x_test[i]);
+      Eigen::Index chosen = 0;
+      r.maxCoeff(&chosen);
+      correct += static_cast<size_t>(chosen) == y_test[i];
+    }
+  });
+
+  for (const std::string& path :
+       {train_images, train_labels, test_images, test_labels, model_path}) {
+    std::filesystem::remove(path);
+  }
+
+  std::ostringstream json;
+  json << std::fixed << std::setprecision(3) << "{\n"
+       << "  \"train_size\": " << options.train_size << ",\n"
+       << "  \"test_size\": " << options.test_size << ",\n"
+       << "  \"epochs\": " << options.epochs << ",\n"
+       << "  \"repeats\": " << options.repeats << ",\n"
+       << "  \"phases\": {\n"
+       << timer.GetJson() << "\n  },\n"
+       << "  \"train_samples_per_sec\": "
+       << static_cast<double>(options.train_size * options.epochs) /
+              train_seconds
+       << ",\n"
+       << "  \"eval_samples_per_sec\": "
+       << static_cast<double>(options.test_size) / eval_seconds << ",\n"
+       << "  \"process_peak_rss_mb\": " << GetProcessPeakRssMb() << ",\n"
+       << "  \"accuracy\": "
+       << static_cast<double>(correct) /
+              static_cast<double>(std::max<size_t>(1, options.test_size))
+       << "\n}\n";
+
+  std::cout << json.str();
+  if (!options.output.empty()) {
+    std::ofstream(options.output) << json.str();
+  }
+
+  if (!options.baseline.empty() &&
+      !CompareWithBaseline(json.str(), options.baseline, options.threshold)) {
+    return 1;
+  }
+  return 0;
+}
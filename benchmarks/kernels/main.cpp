@@ -0,0 +1,137 @@
+#include <mlp/mlp.h>
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../src/kernels.h"
+
+// Times every kernel of every ISA supported by the host against the plain
+// Eigen expressions the layers used before, on the shapes of the digits
+// example. The sparse kernels run at several densities of x (rows named
+// sparse_*@density), the layers switch to them below
+// kernels::GetSparseDensity().
+//
+// Usage: mlp-kernels-benchmark [milliseconds_per_case]
+
+using mlp::kernels::Isa;
+
+struct Shape {
+  ssize_t rows;
+  ssize_t cols;
+};
+
+double TimeNanoseconds(const std::function<void()>& f, double milliseconds) {
+  using Clock = std::chrono::steady_clock;
+
+  size_t calls = 0;
+  auto start = Clock::now();
+  std::chrono::duration<double, std::milli> elapsed(0);
+  while (elapsed.count() < milliseconds) {
+    for (int i = 0; i < 64; ++i) {
+      f();
+    }
+    calls += 64;
+    elapsed = Clock::now() - start;
+  }
+  return elapsed.count() * 1e6 / static_cast<double>(calls);
+}
+
+void Report(const std::string& kernel, const Shape& shape,
+            const std::string& isa, double nanoseconds) {
+  // every kernel does rows * cols multiply-adds
+  double flops = 2.0 * static_cast<double>(shape.rows * shape.cols);
+  std::cout << std::left << std::setw(20) << kernel << std::setw(10)
+            << (std::to_string(shape.rows) + "x" + std::to_string(shape.cols))
+            << std::setw(10) << isa << std::right << std::setw(12)
+            << std::fixed << std::setprecision(1) << nanoseconds
+            << std::setw(10) << std::setprecision(2) << flops / nanoseconds
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  double milliseconds = argc > 1 ? std::stod(argv[1]) : 200;
+
+  const std::vector<Shape> shapes = {
+      {16, 784}, {16, 16}, {10, 16}, {64, 784}, {128, 128}, {784, 16}};
+
+  std::cout << std::left << std::setw(20) << "kernel" << std::setw(10)
+            << "shape" << std::setw(10) << "isa" << std::right
+            << std::setw(12) << "ns/call" << std::setw(10) << "GFLOP/s"
+            << std::endl;
+
+  for (const auto& shape : shapes) {
+    mlp::Matrix A = mlp::Matrix::Random(shape.rows, shape.cols);
+    mlp::Vector x = mlp::Vector::Random(shape.cols);
+    mlp::Vector b = mlp::Vector::Random(shape.rows);
+    mlp::Vector v = mlp::Vector::Random(shape.rows);
+    mlp::Vector y(shape.rows);
+    mlp::Vector r(shape.cols);
+    // keeps the accumulated matrix bounded
+    double step = 1e-9;
+
+    Report("gemv", shape, "eigen", TimeNanoseconds([&] {
+             y.noalias() = A * x + b;
+           }, milliseconds));
+    Report("gemv_transposed", shape, "eigen", TimeNanoseconds([&] {
+             r.noalias() = A.transpose() * v;
+           }, milliseconds));
+    Report("rank1_update", shape, "eigen", TimeNanoseconds([&] {
+             A.noalias() += (step * v) * x.transpose();
+           }, milliseconds));
+
+    for (Isa isa : {Isa::kGeneric, Isa::kSse42, Isa::kAvx2, Isa::kAvx512}) {
+      if (!mlp::kernels::IsIsaSupported(isa)) {
+        continue;
+      }
+      const auto& table = mlp::kernels::GetKernelTable(isa);
+      std::string name = mlp::kernels::GetIsaName(isa);
+      mlp::Vector u = step * v;
+
+      Report("gemv", shape, name, TimeNanoseconds([&] {
+               table.gemv(A.data(), shape.rows, shape.cols, x.data(),
+                          b.data(), y.data());
+             }, milliseconds));
+      Report("gemv_transposed", shape, name, TimeNanoseconds([&] {
+               table.gemv_transposed(A.data(), shape.rows, shape.cols,
+                                     v.data(), r.data());
+             }, milliseconds));
+      Report("rank1_update", shape, name, TimeNanoseconds([&] {
+               table.rank1_update(A.data(), shape.rows, shape.cols, u.data(),
+                                  x.data());
+             }, milliseconds));
+
+      for (double density : {0.1, 0.25, 0.5, 0.75}) {
+        // evenly spread nonzeros, like the active units of a relu layer
+        std::vector<ssize_t> nz;
+        for (ssize_t j = 0; j < shape.cols; ++j) {
+          if (static_cast<ssize_t>((j + 1) * density) >
+              static_cast<ssize_t>(j * density)) {
+            nz.push_back(j);
+          }
+        }
+        ssize_t num_of_nz = static_cast<ssize_t>(nz.size());
+        std::string suffix =
+            "@" + std::to_string(static_cast<int>(density * 100)) + "%";
+
+        Report("sparse_gemv" + suffix, shape, name, TimeNanoseconds([&] {
+                 table.sparse_gemv(A.data(), shape.rows, shape.cols, nz.data(),
+                                   num_of_nz, x.data(), b.data(), y.data());
+               }, milliseconds));
+        Report("sparse_gemv_t" + suffix, shape, name, TimeNanoseconds([&] {
+                 table.sparse_gemv_transposed(A.data(), shape.rows,
+                                              shape.cols, nz.data(),
+                                              num_of_nz, v.data(), r.data());
+               }, milliseconds));
+        Report("sparse_rank1" + suffix, shape, name, TimeNanoseconds([&] {
+                 table.sparse_rank1_update(A.data(), shape.rows, shape.cols,
+                                           nz.data(), num_of_nz, u.data(),
+                                           x.data());
+               }, milliseconds));
+      }
+    }
+  }
+}
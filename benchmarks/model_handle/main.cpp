@@ -0,0 +1,140 @@
+#include <mlp/model_handle.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../tests/test_util.h"
+
+// Latency of Calculate on serving threads while the same model trains in
+// the background: without training, with a mutex held around every update
+// and read, and through a ModelHandle the trainer publishes into after
+// every batch.
+//
+// Usage: mlp-model-handle-benchmark [num_of_readers] [milliseconds]
+
+enum { INPUT_SIZE = 28 * 28, NUM_OF_CLASSES = 10 };
+
+enum class Mode { kIdle, kMutex, kHandle };
+
+mlp::MultilayerPerceptron MakeModel() {
+  mlp::MultilayerPerceptron model =
+      test_util::MakeModel({INPUT_SIZE, 64, 16, NUM_OF_CLASSES}, 42);
+  model.GetParameterSpan() /= std::sqrt(static_cast<double>(INPUT_SIZE));
+  model.SetBatchSize(50);
+  return model;
+}
+
+double Percentile(std::vector<double>& values, double fraction) {
+  auto position = values.begin() + static_cast<ssize_t>(
+                                        fraction * (values.size() - 1));
+  std::nth_element(values.begin(), position, values.end());
+  return *position;
+}
+
+void Run(Mode mode, size_t num_of_readers, double milliseconds,
+         const mlp::DataSet& input, const mlp::DataSet& output) {
+  using Clock = std::chrono::steady_clock;
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::ModelHandle handle(model);
+  std::mutex mutex;
+  std::atomic<bool> done{false};
+
+  // trains one batch at a time so the mutex mode can lock around updates
+  std::thread trainer;
+  size_t num_of_batches = 0;
+  if (mode != Mode::kIdle) {
+    if (mode == Mode::kHandle) {
+      model.SetUpdateCallback(handle.MakePublisher(1));
+    }
+    trainer = std::thread([&] {
+      size_t batch_size = model.GetBatchSize();
+      for (size_t i = 0; !done.load(); i = (i + batch_size) % input.size()) {
+        std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+        if (mode == Mode::kMutex) {
+          lock.lock();
+        }
+        for (size_t j = i; j < std::min(i + batch_size, input.size()); ++j) {
+          model.TrainOnOneSample(mlp::to_Vector(input[j]),
+                                 mlp::to_Vector(output[j]));
+        }
+        model.UpdateParameters();
+        ++num_of_batches;
+      }
+    });
+  }
+
+  std::vector<std::vector<double>> latencies(num_of_readers);
+  std::vector<std::thread> readers;
+  for (size_t r = 0; r < num_of_readers; ++r) {
+    readers.emplace_back([&, r] {
+      mlp::ModelHandle::Reader reader(handle);
+      mlp::Vector x = mlp::to_Vector(input[r]);
+      double checksum = 0;
+      while (!done.load()) {
+        auto start = Clock::now();
+        if (mode == Mode::kMutex) {
+          std::lock_guard<std::mutex> lock(mutex);
+          checksum += model.Calculate(x)[0];
+        } else {
+          checksum += reader.Get().Calculate(x)[0];
+        }
+        std::chrono::duration<double, std::micro> elapsed =
+            Clock::now() - start;
+        latencies[r].push_back(elapsed.count());
+      }
+      if (checksum < 0) {
+        std::cout << checksum << std::endl;
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(
+      std::chrono::duration<double, std::milli>(milliseconds));
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  if (trainer.joinable()) {
+    trainer.join();
+  }
+
+  std::vector<double> all;
+  for (const auto& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+
+  const char* names[] = {"idle", "mutex", "handle"};
+  std::cout << std::left << std::setw(10) << names[static_cast<int>(mode)]
+            << std::right << std::setw(12) << all.size() << std::setw(10)
+            << std::fixed << std::setprecision(1) << Percentile(all, 0.5)
+            << std::setw(10) << Percentile(all, 0.99) << std::setw(10)
+            << Percentile(all, 0.999) << std::setw(10) << num_of_batches
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  size_t num_of_readers = argc > 1 ? std::stoul(argv[1]) : 2;
+  double milliseconds = argc > 2 ? std::stod(argv[2]) : 2000;
+
+  mlp::DataSet input, output;
+  test_util::MakeDataSet(2000, INPUT_SIZE, NUM_OF_CLASSES, 2023, input,
+                         output);
+
+  std::cout << std::left << std::setw(10) << "training" << std::right
+            << std::setw(12) << "requests" << std::setw(10) << "p50 us"
+            << std::setw(10) << "p99 us" << std::setw(10) << "p99.9 us"
+            << std::setw(10) << "batches" << std::endl;
+  for (Mode mode : {Mode::kIdle, Mode::kMutex, Mode::kHandle}) {
+    Run(mode, num_of_readers, milliseconds, input, output);
+  }
+  return 0;
+}
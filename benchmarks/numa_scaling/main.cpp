@@ -0,0 +1,105 @@
+#include <mlp/mlp.h>
+#include <mlp/replicated_model.h>
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../tests/test_util.h"
+
+// Scaling of Hogwild training and batch inference with the number of
+// threads, unpinned against workers pinned to the NUMA nodes with the data
+// placed on the workers (training) or one copy of the weights per node
+// (inference). Thread counts go up to every CPU, so the last rows span all
+// sockets.
+//
+// Usage: mlp-numa-scaling-benchmark [num_of_samples] [num_of_iterations]
+
+enum { INPUT_SIZE = 28 * 28, NUM_OF_CLASSES = 10 };
+
+mlp::MultilayerPerceptron MakeModel() {
+  mlp::MultilayerPerceptron model =
+      test_util::MakeModel({INPUT_SIZE, 128, 32, NUM_OF_CLASSES}, 42);
+  model.GetParameterSpan() /= std::sqrt(static_cast<double>(INPUT_SIZE));
+  return model;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  size_t num_of_samples = argc > 1 ? std::stoul(argv[1]) : 20000;
+  size_t num_of_iterations = argc > 2 ? std::stoul(argv[2]) : 2;
+
+  const mlp::NumaTopology& topology = mlp::NumaTopology::Get();
+  size_t num_of_cpus = 0;
+  std::cout << "nodes:";
+  for (size_t node = 0; node < topology.GetNumOfNodes(); ++node) {
+    std::cout << " " << topology.GetCpus(node).size();
+    num_of_cpus += topology.GetCpus(node).size();
+  }
+  std::cout << " cpus" << std::endl;
+
+  mlp::DataSet input, output;
+  test_util::MakeDataSet(num_of_samples, INPUT_SIZE, NUM_OF_CLASSES, 2023,
+                         input, output);
+
+  std::vector<mlp::Vector> inputs;
+  for (const auto& x : input) {
+    inputs.push_back(mlp::to_Vector(x));
+  }
+
+  std::vector<size_t> thread_counts;
+  for (size_t threads = 1; threads < num_of_cpus; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(num_of_cpus);
+
+  std::cout << std::left << std::setw(10) << "threads" << std::right
+            << std::setw(16) << "train free" << std::setw(16)
+            << "train pinned" << std::setw(16) << "infer free"
+            << std::setw(16) << "infer pinned" << "   samples/sec"
+            << std::endl;
+
+  for (size_t threads : thread_counts) {
+    std::cout << std::left << std::setw(10) << threads << std::right
+              << std::fixed << std::setprecision(0);
+
+    double processed = static_cast<double>(num_of_samples * num_of_iterations);
+    for (bool pinned : {false, true}) {
+      mlp::AsyncTrainingOptions options;
+      options.num_of_threads = threads;
+      options.local_batch_size = 8;
+      options.affinity =
+          pinned ? mlp::ThreadAffinity::kCore : mlp::ThreadAffinity::kNone;
+      options.place_data_on_workers = pinned;
+
+      mlp::MultilayerPerceptron model = MakeModel();
+      auto start = std::chrono::steady_clock::now();
+      model.TrainAsync(num_of_iterations, input, output, options);
+      std::cout << std::setw(16) << processed / Seconds(start);
+    }
+
+    mlp::MultilayerPerceptron model = MakeModel();
+    for (bool pinned : {false, true}) {
+      mlp::ThreadPool pool(threads, pinned ? mlp::ThreadAffinity::kCore
+                                           : mlp::ThreadAffinity::kNone);
+      mlp::ReplicatedModel replicas(model, pool);
+
+      auto start = std::chrono::steady_clock::now();
+      for (size_t it = 0; it < num_of_iterations; ++it) {
+        replicas.Calculate(inputs);
+      }
+      std::cout << std::setw(16) << processed / Seconds(start);
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
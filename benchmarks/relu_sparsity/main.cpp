@@ -0,0 +1,123 @@
+#include <mlp/mlp.h>
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../src/kernels.h"
+#include "../../tests/test_util.h"
+
+// Training and inference of a deep relu net with the dense kernels only
+// against the default switch to the sparse kernels (see
+// kernels::GetSparseDensity). The biases of the hidden layers shift how many
+// relu units are active, the density column is the measured fraction of
+// nonzero hidden outputs. The input is sparse like the digits at every bias.
+//
+// Usage: mlp-relu-sparsity-benchmark [num_of_samples] [num_of_iterations]
+
+enum { INPUT_SIZE = 28 * 28, HIDDEN_SIZE = 256, NUM_OF_CLASSES = 10 };
+
+void MakeDataSet(size_t num_of_samples, mlp::DataSet& input,
+                 mlp::DataSet& output) {
+  std::mt19937 gen(2023);
+  std::uniform_real_distribution<double> pixel(0.0, 1.0);
+
+  input.assign(num_of_samples, std::vector<double>(INPUT_SIZE));
+  output.assign(num_of_samples, std::vector<double>(NUM_OF_CLASSES, 0.0));
+  for (size_t i = 0; i < num_of_samples; ++i) {
+    // as sparse as the digits: most of the pixels are background
+    for (auto& p : input[i]) {
+      p = pixel(gen) < 0.2 ? pixel(gen) : 0.0;
+    }
+    output[i][i % NUM_OF_CLASSES] = 1.0;
+  }
+}
+
+mlp::MultilayerPerceptron MakeModel(double bias) {
+  mlp::MultilayerPerceptron model = test_util::MakeModel(
+      {INPUT_SIZE, HIDDEN_SIZE, HIDDEN_SIZE, HIDDEN_SIZE, NUM_OF_CLASSES}, 42);
+
+  // the span holds A and b of every layer, each padded to a cache line
+  Eigen::Map<mlp::Vector> span = model.GetParameterSpan();
+  ssize_t offset = 0;
+  for (size_t i = 0; i < model.GetNumOfLayers(); ++i) {
+    ssize_t rows = model.GetLinearLayer(i).GetOutputSize();
+    ssize_t cols = model.GetLinearLayer(i).GetInputSize();
+    ssize_t A_size = static_cast<ssize_t>(
+        mlp::PadToCacheLine(static_cast<size_t>(rows * cols)));
+
+    span.segment(offset, rows * cols) /= std::sqrt(static_cast<double>(cols));
+    span.segment(offset + A_size, rows).setConstant(bias);
+    offset += static_cast<ssize_t>(mlp::GetLayerBlockSize(cols, rows));
+  }
+  return model;
+}
+
+// fraction of the nonzero outputs of the hidden layers
+double GetHiddenDensity(const mlp::MultilayerPerceptron& model,
+                        const mlp::DataSet& input) {
+  double nonzeros = 0.0;
+  double total = 0.0;
+  for (size_t i = 0; i < input.size() && i < 100; ++i) {
+    mlp::Vector val = mlp::to_Vector(input[i]);
+    for (size_t l = 0; l + 1 < model.GetNumOfLayers(); ++l) {
+      val = model.GetLinearLayer(l).Calculate(val);
+      val = model.GetNonLinearLayer(l).Calculate(val);
+      nonzeros += static_cast<double>((val.array() != 0.0).count());
+      total += static_cast<double>(val.size());
+    }
+  }
+  return nonzeros / total;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  size_t num_of_samples = argc > 1 ? std::stoul(argv[1]) : 5000;
+  size_t num_of_iterations = argc > 2 ? std::stoul(argv[2]) : 1;
+
+  mlp::DataSet input, output;
+  MakeDataSet(num_of_samples, input, output);
+
+  std::cout << std::left << std::setw(10) << "bias" << std::setw(10)
+            << "density" << std::setw(10) << "kernels" << std::right
+            << std::setw(16) << "train/sec" << std::setw(16) << "infer/sec"
+            << std::endl;
+
+  double default_density = mlp::kernels::GetSparseDensity();
+  for (double bias : {0.5, 0.0, -0.1, -0.2}) {
+    double density = GetHiddenDensity(MakeModel(bias), input);
+
+    for (bool sparse : {false, true}) {
+      mlp::kernels::SetSparseDensity(sparse ? default_density : 0.0);
+      mlp::MultilayerPerceptron model = MakeModel(bias);
+
+      auto start = std::chrono::steady_clock::now();
+      model.Train(num_of_iterations, input, output);
+      double train = static_cast<double>(num_of_samples * num_of_iterations) /
+                     Seconds(start);
+
+      start = std::chrono::steady_clock::now();
+      for (const auto& x : input) {
+        model.Calculate(mlp::to_Vector(x));
+      }
+      double infer = static_cast<double>(num_of_samples) / Seconds(start);
+
+      std::cout << std::left << std::fixed << std::setprecision(2)
+                << std::setw(10) << bias << std::setw(10) << density
+                << std::setw(10) << (sparse ? "sparse" : "dense") << std::right
+                << std::setw(16) << std::setprecision(0) << train
+                << std::setw(16) << infer << std::endl;
+    }
+  }
+  mlp::kernels::SetSparseDensity(default_density);
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include <mlp/mlp.h>
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../tests/test_util.h"
+
+// Compares Train on an in-memory DataSet with Train streaming the same
+// samples from a sharded data set on disk, for every feature encoding.
+//
+// Usage: mlp-sharded-dataset-benchmark [num_of_samples] [num_of_iterations]
+//                                      [directory]
+//
+// The streaming runs go first, so their peak RSS doesn't include the
+// in-memory data set.
+
+enum { INPUT_SIZE = 28 * 28, NUM_OF_CLASSES = 10 };
+
+// MNIST-like samples generated one by one, identical for every call
+class SyntheticSamples {
+ public:
+  SyntheticSamples() : _gen(2023), _prototypes(NUM_OF_CLASSES) {
+    std::uniform_real_distribution<double> pixel(0.0, 1.0);
+    for (auto& prototype : _prototypes) {
+      prototype.resize(INPUT_SIZE);
+      for (auto& p : prototype) {
+        p = pixel(_gen) < 0.2 ? pixel(_gen) : 0.0;
+      }
+    }
+  }
+
+  void Next(size_t i, std::vector<double>& input,
+            std::vector<double>& output) {
+    std::normal_distribution<double> noise(0.0, 0.2);
+    size_t label = i % NUM_OF_CLASSES;
+    input = _prototypes[label];
+    for (auto& p : input) {
+      // quantized like real pixels, so kUInt8 stores them exactly
+      p = std::round(std::min(1.0, std::max(0.0, p + noise(_gen))) * 255.0) /
+          255.0;
+    }
+    output.assign(NUM_OF_CLASSES, 0.0);
+    output[label] = 1.0;
+  }
+
+ private:
+  std::mt19937 _gen;
+  std::vector<std::vector<double>> _prototypes;
+};
+
+mlp::MultilayerPerceptron MakeModel() {
+  return test_util::MakeModel({INPUT_SIZE, 16, 16, NUM_OF_CLASSES}, 42);
+}
+
+double GetPeakRssMb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+
+void Report(const std::string& name, size_t processed, double seconds,
+            uintmax_t bytes_on_disk) {
+  std::cout << std::left << std::setw(12) << name << std::right
+            << std::setw(14) << std::fixed << std::setprecision(0)
+            << static_cast<double>(processed) / seconds << std::setw(14)
+            << std::setprecision(1)
+            << static_cast<double>(bytes_on_disk) / (1 << 20) << std::setw(14)
+            << GetPeakRssMb() << std::endl;
+}
+
+uintmax_t GetDirectorySize(const std::string& directory) {
+  uintmax_t size = 0;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(directory)) {
+    size += entry.file_size();
+  }
+  return size;
+}
+
+int main(int argc, char** argv) {
+  size_t num_of_samples = argc > 1 ? std::stoul(argv[1]) : 20000;
+  size_t num_of_iterations = argc > 2 ? std::stoul(argv[2]) : 3;
+  std::string directory =
+      argc > 3 ? argv[3]
+               : (std::filesystem::temp_directory_path() / "mlp-shards")
+                     .string();
+
+  size_t processed = num_of_samples * num_of_iterations;
+
+  std::cout << std::left << std::setw(12) << "source" << std::right
+            << std::setw(14) << "samples/sec" << std::setw(14) << "disk, MB"
+            << std::setw(14) << "peak RSS, MB" << std::endl;
+
+  const std::pair<const char*, mlp::FeatureEncoding> encodings[] = {
+      {"uint8", mlp::FeatureEncoding::kUInt8},
+      {"float16", mlp::FeatureEncoding::kFloat16},
+      {"float32", mlp::FeatureEncoding::kFloat32},
+      {"float64", mlp::FeatureEncoding::kFloat64},
+  };
+
+  for (const auto& [name, encoding] : encodings) {
+    std::filesystem::remove_all(directory);
+
+    mlp::ShardedDataSetOptions options;
+    options.input_encoding = encoding;
+    options.output_encoding = mlp::OutputEncoding::kClassIndex;
+    options.records_per_shard = 4096;
+    {
+      mlp::ShardedDataSetWriter writer(directory, INPUT_SIZE, NUM_OF_CLASSES,
+                                       options);
+      SyntheticSamples samples;
+      std::vector<double> input, output;
+      for (size_t i = 0; i < num_of_samples; ++i) {
+        samples.Next(i, input, output);
+        writer.Add(input, output);
+      }
+      if (!writer.Finish()) {
+        std::cerr << "Can't write " << directory << std::endl;
+        return 1;
+      }
+    }
+
+    mlp::ShardedDataSetReader reader(directory);
+    mlp::MultilayerPerceptron model = MakeModel();
+    auto start = std::chrono::steady_clock::now();
+    model.Train(num_of_iterations, reader);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    Report(name, processed, elapsed.count(), GetDirectorySize(directory));
+  }
+  std::filesystem::remove_all(directory);
+
+  mlp::DataSet input(num_of_samples), output(num_of_samples);
+  SyntheticSamples samples;
+  for (size_t i = 0; i < num_of_samples; ++i) {
+    samples.Next(i, input[i], output[i]);
+  }
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  auto start = std::chrono::steady_clock::now();
+  model.Train(num_of_iterations, input, output);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  Report("in-memory", processed, elapsed.count(), 0);
+}
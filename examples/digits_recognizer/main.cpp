@@ -1,100 +1,17 @@
 #include <mlp/mlp.h>
 
-#include <inttypes.h>
-#include <cassert>
-#include <fstream>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <string>
 #include <vector>
 
-using Image = std::vector<double>;
-using Label = int8_t;
+using Images = mlp::FeatureBatch<uint8_t>;
+using Label = uint8_t;
 
-enum { MAGIC_NUMBER_IMAGES = 2051, MAGIC_NUMBER_LABELS = 2049 };
-
-int32_t read_int32(std::ifstream& f) {
-  int32_t x = 0;
-  f.read(reinterpret_cast<char*>(&x), sizeof(x));
-  x = __builtin_bswap32(x);
-  return x;
-}
-
-double read_pixel(std::ifstream& f) {
-  uint8_t pixel;
-  f.read(reinterpret_cast<char*>(&pixel), sizeof(pixel));
-  return static_cast<double>(pixel) / 255.0;
-}
-
-uint8_t read_label(std::ifstream& f) {
-  uint8_t label;
-  f.read(reinterpret_cast<char*>(&label), sizeof(label));
-  return label;
-}
-
-std::vector<Image> readImages(const std::string& file_path) {
-  std::ifstream f(file_path, std::ios::binary);
-
-  assert(f);
-
-  int32_t magic_number, number_of_images, number_of_rows, number_of_columns;
-
-  magic_number = read_int32(f);
-  assert(magic_number == MAGIC_NUMBER_IMAGES);
-
-  number_of_images = read_int32(f);
-  number_of_rows = read_int32(f);
-  number_of_columns = read_int32(f);
-
-  int32_t size_of_image = number_of_rows * number_of_columns;
-
-  std::vector<Image> images(number_of_images);
-
-  for (size_t i = 0; i < static_cast<size_t>(number_of_images); ++i) {
-    images[i].resize(size_of_image);
-
-    for (size_t j = 0; j < static_cast<size_t>(size_of_image); ++j) {
-      images[i][j] = read_pixel(f);
-    }
-  }
-
-  return images;
-}
-
-std::vector<Label> readLabels(const std::string& file_path) {
-  std::ifstream f(file_path, std::ios::binary);
-
-  int32_t magic_number, number_of_items;
-
-  magic_number = read_int32(f);
-  assert(magic_number == MAGIC_NUMBER_LABELS);
-
-  number_of_items = read_int32(f);
-
-  std::vector<Label> labels(number_of_items);
-
-  for (size_t i = 0; i < static_cast<size_t>(number_of_items); ++i) {
-    labels[i] = read_label(f);
-  }
-
-  return labels;
-}
-
-std::vector<double> LabelToVector(const Label& l) {
-  std::vector<double> r(10, 0);
-  r[l] = 1.0;
-  return r;
-}
-
-mlp::DataSet LabelsToDataSet(const std::vector<Label>& labels) {
-  mlp::DataSet data_set(labels.size());
-  for (size_t i = 0; i < data_set.size(); ++i) {
-    data_set[i] = LabelToVector(labels[i]);
-  }
-  return data_set;
-}
-
-bool IsOk(const mlp::MultilayerPerceptron& model, const Image& image,
+bool IsOk(const mlp::MultilayerPerceptron& model, const uint8_t* image,
           const Label& label) {
-  mlp::Vector r = model.Calculate(mlp::to_Vector(image));
+  mlp::Vector r = model.Calculate(image);
   size_t chosen = 0;
   for (ssize_t i = 0; i < r.size(); ++i) {
     if (r[i] > r[chosen]) {
@@ -106,7 +23,7 @@ bool IsOk(const mlp::MultilayerPerceptron& model, const Image& image,
 }
 
 double GetAccuracy(const mlp::MultilayerPerceptron& model,
-                   const std::vector<Image>& images_test_set,
+                   const Images& images_test_set,
                    const std::vector<Label>& labels_test_set) {
   size_t test_size = images_test_set.size();
   size_t correct_answers = 0;
@@ -122,16 +39,40 @@ double GetAccuracy(const mlp::MultilayerPerceptron& model,
   return accur_rate;
 }
 
-int main() {
-  auto images_training_set = readImages(
-      "/home/kazalika/multilayer_perceptron/examples/digits_recognizer/data/"
-      "train-images.idx3-ubyte");
-  auto labels_training_set = readLabels(
-      "/home/kazalika/multilayer_perceptron/examples/digits_recognizer/data/"
-      "train-labels.idx1-ubyte");
+// accuracy and time of the exact and the "fast_" activations of the model
+void CompareActivations(const mlp::MultilayerPerceptron& model,
+                        const Images& images_test_set,
+                        const std::vector<Label>& labels_test_set) {
+  mlp::MultilayerPerceptron fast_model = model;
+  fast_model.SetFastActivations(true);
+
+  for (bool fast : {false, true}) {
+    auto start = std::chrono::steady_clock::now();
+    double accuracy = GetAccuracy(fast ? fast_model : model, images_test_set,
+                                  labels_test_set);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << (fast ? "Fast" : "Exact") << " activations: accuracy "
+              << accuracy * 100 << "%, " << elapsed.count() << " s"
+              << std::endl;
+  }
+}
+
+// Usage: mlp-digits-recognizer [data_dir] [model_path]
+//
+// data_dir holds the MNIST IDX files, by default data/ of the working
+// directory (run it from examples/digits_recognizer).
+int main(int argc, char** argv) {
+  std::string data_dir = argc > 1 ? argv[1] : "data";
+  std::string model_path = argc > 2 ? argv[2] : "models/V1";
 
-  mlp::DataSet X_train = images_training_set;
-  mlp::DataSet Y_train = LabelsToDataSet(labels_training_set);
+  Images images_training_set =
+      mlp::ReadIdxImagesRaw(data_dir + "/train-images.idx3-ubyte");
+  auto labels_training_set =
+      mlp::ReadIdxLabels(data_dir + "/train-labels.idx1-ubyte");
+
+  mlp::DataSet Y_train = mlp::LabelsToDataSet(labels_training_set, 10);
 
   mlp::ActivationFunctionsList act_funcs;
   mlp::LossFunctionsList loss_funcs;
@@ -144,17 +85,26 @@ int main() {
 
   mlp::MultilayerPerceptron model({28 * 28, 16, 16, 10}, {ReLU, ReLU, Softmax},
                                   L);
-
-  auto images_test_set = readImages(
-      "/home/kazalika/multilayer_perceptron/examples/digits_recognizer/data/"
-      "t10k-images.idx3-ubyte");
-  auto labels_test_set = readLabels(
-      "/home/kazalika/multilayer_perceptron/examples/digits_recognizer/data/"
-      "t10k-labels.idx1-ubyte");
+  // the pixels stay bytes, the scaling is folded into the first layer
+  model.SetInputNormalization(mlp::Vector::Constant(28 * 28, 1.0 / 255.0),
+                              mlp::Vector::Zero(28 * 28));
+
+  Images images_test_set =
+      mlp::ReadIdxImagesRaw(data_dir + "/t10k-images.idx3-ubyte");
+  auto labels_test_set =
+      mlp::ReadIdxLabels(data_dir + "/t10k-labels.idx1-ubyte");
+
+  if (images_training_set.size() == 0 ||
+      images_training_set.size() != labels_training_set.size() ||
+      images_test_set.size() == 0 ||
+      images_test_set.size() != labels_test_set.size()) {
+    std::cerr << "No MNIST data in " << data_dir << std::endl;
+    return 1;
+  }
 
   std::cout << "Training started" << std::endl;
 
-  model.Train(5, X_train, Y_train);
+  model.Train(5, images_training_set, Y_train);
 
   std::cout << "Trained!" << std::endl;
 
@@ -162,18 +112,18 @@ int main() {
             << GetAccuracy(model, images_test_set, labels_test_set) * 100 << "%"
             << std::endl;
 
-  model.SaveModel(
-      "/home/kazalika/multilayer_perceptron/examples/digits_recognizer/models/"
-      "V1");
+  model.SaveModel(model_path);
 
   std::cout << "Saved model!" << std::endl;
 
+  CompareActivations(model, images_test_set, labels_test_set);
+
   mlp::MultilayerPerceptron loaded_model;
-  loaded_model.LoadModel(
-      "/home/kazalika/multilayer_perceptron/examples/digits_recognizer/models/"
-      "V1",
-      act_funcs, loss_funcs);
-  loaded_model.Train(5, X_train, Y_train);
+  if (!loaded_model.LoadModel(model_path, act_funcs, loss_funcs)) {
+    std::cerr << "Can't read model " << model_path << std::endl;
+    return 1;
+  }
+  loaded_model.Train(5, images_training_set, Y_train);
 
   std::cout << "Accuracy after load and 5 more iterations is "
             << GetAccuracy(loaded_model, images_test_set, labels_test_set) * 100
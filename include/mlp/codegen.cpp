@@ -0,0 +1,226 @@
+#include "codegen.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace mlp {
+
+namespace {
+
+enum class Activation {
+  kRelu,
+  kSigmoid,
+  kTanh,
+  kSoftmax,
+  kIdentity,
+  kUnknown
+};
+
+Activation GetActivation(const std::string& name) {
+  const std::string fast = "fast_";
+  std::string base = name.compare(0, fast.size(), fast) == 0
+                         ? name.substr(fast.size())
+                         : name;
+
+  if (base == "relu") {
+    return Activation::kRelu;
+  }
+  if (base == "sigmoid") {
+    return Activation::kSigmoid;
+  }
+  if (base == "tanh") {
+    return Activation::kTanh;
+  }
+  if (base == "softmax") {
+    return Activation::kSoftmax;
+  }
+  if (base == "identity") {
+    return Activation::kIdentity;
+  }
+  return Activation::kUnknown;
+}
+
+std::string Literal(double x) {
+  std::ostringstream out;
+  out << std::hexfloat << x;
+  return out.str();
+}
+
+std::string WeightsName(size_t layer, char what) {
+  return "kLayer" + std::to_string(layer) + what;
+}
+
+// buffer with the output of layer i - 1, h0 is the input
+std::string BufferName(size_t i, size_t num_of_layers) {
+  if (i == num_of_layers) {
+    return "output";
+  }
+  return "h" + std::to_string(i);
+}
+
+void WriteWeights(std::ostream& out, size_t index, const LinearLayer& layer) {
+  const MatrixMap& A = layer.GetARef();
+  const VectorMap& b = layer.GetbRef();
+
+  // row-major, so every output is a dot product over contiguous weights
+  out << "alignas(64) inline constexpr double " << WeightsName(index, 'A')
+      << "[" << A.rows() << "][" << A.cols() << "] = {\n";
+  for (ssize_t i = 0; i < A.rows(); ++i) {
+    out << "    {";
+    for (ssize_t j = 0; j < A.cols(); ++j) {
+      out << (j == 0 ? "" : (j % 4 == 0 ? ",\n     " : ", ")) << Literal(A(i, j));
+    }
+    out << "},\n";
+  }
+  out << "};\n\n";
+
+  out << "alignas(64) inline constexpr double " << WeightsName(index, 'b')
+      << "[" << b.size() << "] = {\n";
+  for (ssize_t i = 0; i < b.size(); ++i) {
+    out << "    " << Literal(b[i]) << ",\n";
+  }
+  out << "};\n\n";
+}
+
+void WriteLinear(std::ostream& out, size_t index, const LinearLayer& layer,
+                 const std::string& x, const std::string& y,
+                 const CodegenOptions& options) {
+  ssize_t rows = layer.GetOutputSize();
+  ssize_t cols = layer.GetInputSize();
+  std::string A = "detail::" + WeightsName(index, 'A');
+  std::string b = "detail::" + WeightsName(index, 'b');
+
+  if (static_cast<size_t>(rows * cols) <= options.max_unrolled_weights) {
+    for (ssize_t i = 0; i < rows; ++i) {
+      out << "  " << y << "[" << i << "] = " << b << "[" << i << "]";
+      for (ssize_t j = 0; j < cols; ++j) {
+        out << (j % 4 == 0 ? "\n      + " : " + ") << A << "[" << i << "]["
+            << j << "] * " << x << "[" << j << "]";
+      }
+      out << ";\n";
+    }
+    return;
+  }
+
+  out << "  for (std::size_t i = 0; i < " << rows << "; ++i) {\n"
+      << "    double sum = " << b << "[i];\n"
+      << "    for (std::size_t j = 0; j < " << cols << "; ++j) {\n"
+      << "      sum += " << A << "[i][j] * " << x << "[j];\n"
+      << "    }\n"
+      << "    " << y << "[i] = sum;\n"
+      << "  }\n";
+}
+
+void WriteActivation(std::ostream& out, Activation activation,
+                     ssize_t size, const std::string& y) {
+  std::string loop =
+      "  for (std::size_t i = 0; i < " + std::to_string(size) + "; ++i) {\n";
+
+  switch (activation) {
+    case Activation::kRelu:
+      out << loop << "    " << y << "[i] = " << y << "[i] > 0.0 ? " << y
+          << "[i] : 0.0;\n  }\n";
+      break;
+    case Activation::kSigmoid:
+      out << loop << "    " << y << "[i] = 1.0 / (1.0 + std::exp(-" << y
+          << "[i]));\n  }\n";
+      break;
+    case Activation::kTanh:
+      out << loop << "    " << y << "[i] = std::tanh(" << y << "[i]);\n  }\n";
+      break;
+    case Activation::kSoftmax:
+      // shifted by the max like activation_functions::softmax
+      out << "  {\n"
+          << "    double max = " << y << "[0];\n"
+          << "  " << loop << "      max = " << y << "[i] > max ? " << y
+          << "[i] : max;\n    }\n"
+          << "    double sum = 0.0;\n"
+          << "  " << loop << "      " << y << "[i] = std::exp(" << y
+          << "[i] - max);\n"
+          << "      sum += " << y << "[i];\n    }\n"
+          << "  " << loop << "      " << y << "[i] /= sum;\n    }\n"
+          << "  }\n";
+      break;
+    case Activation::kIdentity:
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+bool GenerateModelHeader(std::ostream& out, const MultilayerPerceptron& model,
+                         const CodegenOptions& options) {
+  size_t num_of_layers = model.GetNumOfLayers();
+  if (num_of_layers == 0) {
+    return false;
+  }
+
+  std::vector<Activation> activations;
+  std::string shape = std::to_string(model.GetInputSize());
+  for (size_t i = 0; i < num_of_layers; ++i) {
+    std::string name =
+        model.GetNonLinearLayer(i).GetActivatioFunc().GetName();
+    activations.push_back(GetActivation(name));
+    if (activations.back() == Activation::kUnknown) {
+      return false;
+    }
+
+    const LinearLayer& layer = model.GetLinearLayer(i);
+    if (!layer.GetARef().allFinite() || !layer.GetbRef().allFinite()) {
+      return false;
+    }
+    shape += " -> " + std::to_string(layer.GetOutputSize()) + " " + name;
+  }
+
+  out << "// Generated by mlp::GenerateModelHeader, do not edit.\n"
+      << "// Model: " << shape << "\n\n"
+      << "#pragma once\n\n"
+      << "#include <cmath>\n"
+      << "#include <cstddef>\n\n"
+      << "namespace " << options.name_space << " {\n\n"
+      << "inline constexpr std::size_t kInputSize = " << model.GetInputSize()
+      << ";\n"
+      << "inline constexpr std::size_t kOutputSize = "
+      << model.GetOutputSize() << ";\n\n"
+      << "namespace detail {\n\n";
+
+  for (size_t i = 0; i < num_of_layers; ++i) {
+    WriteWeights(out, i, model.GetLinearLayer(i));
+  }
+
+  out << "}  // namespace detail\n\n"
+      << "// input has kInputSize elements, output kOutputSize\n"
+      << "inline void predict(const double* input, double* output) {\n"
+      << "  const double* h0 = input;\n";
+
+  for (size_t i = 0; i < num_of_layers; ++i) {
+    const LinearLayer& layer = model.GetLinearLayer(i);
+    std::string x = BufferName(i, num_of_layers);
+    std::string y = BufferName(i + 1, num_of_layers);
+
+    out << "\n  // layer " << i << ": " << layer.GetInputSize() << " -> "
+        << layer.GetOutputSize() << "\n";
+    if (i + 1 < num_of_layers) {
+      out << "  alignas(64) double " << y << "[" << layer.GetOutputSize()
+          << "];\n";
+    }
+    WriteLinear(out, i, layer, x, y, options);
+    WriteActivation(out, activations[i], layer.GetOutputSize(), y);
+  }
+
+  out << "}\n\n"
+      << "}  // namespace " << options.name_space << "\n";
+
+  return static_cast<bool>(out);
+}
+
+bool GenerateModelHeader(const std::string& file_path,
+                         const MultilayerPerceptron& model,
+                         const CodegenOptions& options) {
+  std::ofstream out(file_path);
+  return out && GenerateModelHeader(out, model, options);
+}
+
+}  // namespace mlp
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "mlp.h"
+
+namespace mlp {
+
+struct CodegenOptions {
+  // namespace of the generated code
+  std::string name_space = "mlp_model";
+
+  // layers with at most this many weights become straight-line code, bigger
+  // ones loops with constant bounds that the compiler unrolls and vectorizes
+  // for the exact shape
+  size_t max_unrolled_weights = 4096;
+};
+
+// Writes a self-contained C++17 header for the model: the weights as aligned
+// constexpr arrays (hex float literals, so they are exact) and
+//
+//   void predict(const double* input, double* output);
+//
+// specialized for the shapes of the model. The header needs only <cmath> and
+// <cstddef>. The fast_ activations are emitted as the exact functions, the
+// factors of a FactorizeLayer as two products.
+// Returns false for activations the generator doesn't know or non-finite
+// weights.
+bool GenerateModelHeader(std::ostream& out, const MultilayerPerceptron& model,
+                         const CodegenOptions& options = {});
+
+bool GenerateModelHeader(const std::string& file_path,
+                         const MultilayerPerceptron& model,
+                         const CodegenOptions& options = {});
+
+}  // namespace mlp
@@ -1,92 +1,238 @@
 #include "mlp.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
 
 namespace mlp {
 
 MultilayerPerceptron::MultilayerPerceptron(
     const std::initializer_list<ssize_t>& dimensions,
     const std::initializer_list<ActivationFunction>& act_funcs,
-    LossFunction loss_func) {
+    LossFunction loss_func)
+    : MultilayerPerceptron(std::vector<ssize_t>(dimensions),
+                           std::vector<ActivationFunction>(act_funcs),
+                           loss_func) {}
+
+MultilayerPerceptron::MultilayerPerceptron(
+    const std::vector<ssize_t>& dimensions,
+    const std::vector<ActivationFunction>& act_funcs, LossFunction loss_func) {
   assert(dimensions.size() > 1);
   assert(dimensions.size() == act_funcs.size() + 1);
 
   _m_num_of_layers = dimensions.size() - 1;
   _m_loss = loss_func;
 
-  _m_linear_layers.resize(_m_num_of_layers);
+  std::vector<LinearLayer> linear_layers(_m_num_of_layers);
   _m_non_linear_layers.resize(_m_num_of_layers);
-  _m_delta_linear_layers.resize(_m_num_of_layers);
-
-  auto dims_iterator = dimensions.begin();
-  auto act_func_iterator = act_funcs.begin();
-  _m_input_size = *dims_iterator;
-  ++dims_iterator;
-  for (size_t i = 0; dims_iterator != dimensions.end();
-       ++dims_iterator, ++act_func_iterator, ++i) {
-    _m_linear_layers[i] = LinearLayer(*(dims_iterator - 1), *dims_iterator);
-    _m_non_linear_layers[i] = NonLinearLayer(*act_func_iterator);
-    _m_delta_linear_layers[i] =
-        DeltaLinearLayer(*(dims_iterator - 1), *dims_iterator);
+  _m_frozen_layers.assign(_m_num_of_layers, false);
 
-    if (i + 1 == _m_num_of_layers) {
-      _m_output_size = *dims_iterator;
-    }
+  _m_input_size = dimensions.front();
+  _m_output_size = dimensions.back();
+  for (size_t i = 0; i < _m_num_of_layers; ++i) {
+    linear_layers[i] = LinearLayer(dimensions[i], dimensions[i + 1]);
+    _m_non_linear_layers[i] = NonLinearLayer(act_funcs[i]);
   }
+
+  _m_linear_layers = ParameterArena(linear_layers);
+  _m_gradients = MakeGradientArena();
+  _m_has_gradients = true;
 }
 
 Vector MultilayerPerceptron::Calculate(const Vector& input) const {
   assert(input.size() == _m_input_size);
 
+  Vector val = CalculateLayers(input, 0, _m_num_of_layers);
+
+  assert(val.size() == _m_output_size);
+  return val;
+}
+
+Vector MultilayerPerceptron::CalculateLayers(const Vector& input, size_t begin,
+                                             size_t end) const {
   Vector val = input;
-  for (size_t i = 0; i < _m_num_of_layers; ++i) {
+  for (size_t i = begin; i < end; ++i) {
     val = _m_linear_layers[i].Calculate(val);
     val = _m_non_linear_layers[i].Calculate(val);
   }
-
-  assert(val.size() == _m_output_size);
   return val;
 }
 
+Vector MultilayerPerceptron::Calculate(const uint8_t* raw) const {
+  return CalculateRaw(raw);
+}
+
+Vector MultilayerPerceptron::Calculate(const int16_t* raw) const {
+  return CalculateRaw(raw);
+}
+
+void MultilayerPerceptron::CheckInputNormalization() const {
+  // a public overload, so not only an assert: raw features without a scale
+  // would silently run through an empty folded layer
+  if (!HasInputNormalization()) {
+    throw std::logic_error("raw features without SetInputNormalization");
+  }
+}
+
+template <typename T>
+Vector MultilayerPerceptron::Normalize(const T* raw) const {
+  CheckInputNormalization();
+
+  Vector input(_m_input_size);
+  for (ssize_t j = 0; j < _m_input_size; ++j) {
+    input[j] = _m_input_scale[j] * static_cast<double>(raw[j]) +
+               _m_input_offset[j];
+  }
+  return input;
+}
+
+template <typename T>
+Vector MultilayerPerceptron::CalculateRaw(const T* raw) const {
+  CheckInputNormalization();
+  if (_m_input_layer_stale) {
+    return Calculate(Normalize(raw));
+  }
+
+  // A' * raw + b' column by column, raw features are often zero (e.g. the
+  // background pixels of the digits)
+  const MatrixMap& A = _m_input_layer.GetARef();
+  Vector val = _m_input_layer.GetbRef();
+  for (ssize_t j = 0; j < _m_input_size; ++j) {
+    if (raw[j] != 0) {
+      val.noalias() += A.col(j) * static_cast<double>(raw[j]);
+    }
+  }
+
+  val = _m_non_linear_layers[0].Calculate(val);
+  return CalculateLayers(val, 1, _m_num_of_layers);
+}
+
 void MultilayerPerceptron::TrainOnOneSample(const Vector& input,
                                             const Vector& output) {
+  EnsureGradients();
+  AccumulateGradients(input, output, _m_gradients.GetLayers());
+}
+
+void MultilayerPerceptron::TrainOnOneSample(const uint8_t* raw,
+                                            const Vector& output) {
+  TrainOnOneSample(Normalize(raw), output);
+}
+
+void MultilayerPerceptron::TrainOnOneSample(const int16_t* raw,
+                                            const Vector& output) {
+  TrainOnOneSample(Normalize(raw), output);
+}
+
+void MultilayerPerceptron::AccumulateGradients(
+    const Vector& input, const Vector& output,
+    std::vector<DeltaLinearLayer>& deltas, size_t first_layer) const {
+  size_t first_trainable = first_layer;
+  while (first_trainable < _m_num_of_layers &&
+         _m_frozen_layers[first_trainable]) {
+    ++first_trainable;
+  }
+  if (first_trainable == _m_num_of_layers) {
+    return;
+  }
+
   std::vector<Vector> computed(_m_num_of_layers + 1);
-  computed[0] = input;
+  std::vector<Vector> linear(_m_num_of_layers);
+  computed[first_layer] = input;
 
-  for (size_t i = 1; i < computed.size(); ++i) {
+  for (size_t i = first_layer + 1; i < computed.size(); ++i) {
     // linear = Ax + b
-    Vector linear = _m_linear_layers[i - 1].Calculate(computed[i - 1]);
+    linear[i - 1] = _m_linear_layers[i - 1].Calculate(computed[i - 1]);
     // computed[i] = \sigma(linear)
-    computed[i] = _m_non_linear_layers[i - 1].Calculate(linear);
+    computed[i] = _m_non_linear_layers[i - 1].Calculate(linear[i - 1]);
   }
 
   Vector u = _m_loss.GetDerivative(computed.back(), output);
 
-  for (size_t i = _m_num_of_layers; i-- > 0;) {
+  for (size_t i = _m_num_of_layers; i-- > first_trainable;) {
     // x = z_{i-1}
-    Vector x = computed[i];
+    const Vector& x = computed[i];
 
-    // linear = Ax + b
-    Vector linear = _m_linear_layers[i].Calculate(x);
+    // dS = \sigma'(Ax + b), computed from \sigma(Ax + b) when possible
+    Matrix dS =
+        _m_non_linear_layers[i].ThrowDerivative(linear[i], computed[i + 1]);
 
-    // dS = \sigma'(Ax + b)
-    Matrix dS = _m_non_linear_layers[i].ThrowDerivative(linear);
+    if (!_m_frozen_layers[i]) {
+      // \sigma'(Ax + b) * u * x.T
+      deltas[i].Update_dA(dS * u, x);
 
-    // \sigma'(Ax + b) * u * x.T
-    _m_delta_linear_layers[i].Update_dA(dS * u, x);
+      // \sigma'(Ax + b) * u
+      deltas[i].Update_db(dS * u);
+    }
 
-    // \sigma'(Ax + b) * u
-    _m_delta_linear_layers[i].Update_db(dS * u);
+    if (i == first_trainable) {
+      break;
+    }
 
-    // u_{i - 1} = (u.T * \sigma'(Ax + b) * A).T
-    u = _m_linear_layers[i].ThrowDerivative(dS, u);
+    // u_{i - 1} = (u.T * \sigma'(Ax + b) * A).T, only where the derivative
+    // of layer i - 1 isn't zero
+    if (_m_non_linear_layers[i - 1].HasSparseGradient()) {
+      u = _m_linear_layers[i].ThrowDerivative(dS, u, x);
+    } else {
+      u = _m_linear_layers[i].ThrowDerivative(dS, u);
+    }
   }
 }
 
 void MultilayerPerceptron::UpdateParameters() {
-  for (size_t i = 0; i < _m_num_of_layers; ++i) {
-    _m_linear_layers[i].UpdateParameters(_m_delta_linear_layers[i], batch_size);
-    _m_delta_linear_layers[i].Clear();
+  EnsureGradients();
+  ApplyGradients(_m_gradients);
+  // refolded once per Train, or now for a callback that may serve the model
+  if (_m_num_of_layers > 0 && !_m_frozen_layers[0]) {
+    _m_input_layer_stale = true;
+  }
+
+  if (_m_update_callback) {
+    FoldInputNormalization();
+    _m_update_callback(*this);
+  }
+}
+
+void MultilayerPerceptron::SetUpdateCallback(
+    std::function<void(const MultilayerPerceptron&)> callback) {
+  _m_update_callback = std::move(callback);
+}
+
+void MultilayerPerceptron::ApplyGradients(GradientArena& gradients) {
+  // frozen layers past the first trainable one have zero gradients, so the
+  // pass keeps their weights
+  double* parameters = _m_linear_layers.GetData() + gradients.GetOffset();
+  double* deltas = gradients.GetData();
+  double scale = 1.0 / static_cast<double>(batch_size);
+
+  for (size_t k = 0; k < gradients.GetSize(); ++k) {
+    parameters[k] -= deltas[k] * scale;
+    deltas[k] = 0.0;
+  }
+}
+
+void MultilayerPerceptron::ApplySharedGradients(GradientArena& gradients,
+                                                MultilayerPerceptron& local) {
+  double* parameters = _m_linear_layers.GetData() + gradients.GetOffset();
+  double* copy = local._m_linear_layers.GetData() + gradients.GetOffset();
+  double* deltas = gradients.GetData();
+  double scale = 1.0 / static_cast<double>(batch_size);
+
+  // relaxed atomics are plain moves on x86 and ARM, but keep the concurrent
+  // reads and writes of the other workers defined (__atomic_load_n takes
+  // only integers and pointers, the generic builtins take any 8 bytes)
+  for (size_t k = 0; k < gradients.GetSize(); ++k) {
+    double p = 0.0;
+    __atomic_load(&parameters[k], &p, __ATOMIC_RELAXED);
+    p -= deltas[k] * scale;
+    __atomic_store(&parameters[k], &p, __ATOMIC_RELAXED);
+    copy[k] = p;
+    deltas[k] = 0.0;
   }
 }
 
@@ -100,21 +246,625 @@ Vector to_Vector(const std::vector<double>& v) {
   return result;
 }
 
+void MultilayerPerceptron::FreezeLayer(size_t index) {
+  assert(index < _m_num_of_layers);
+
+  _m_frozen_layers[index] = true;
+  ResetGradients();
+}
+
+void MultilayerPerceptron::UnfreezeLayer(size_t index) {
+  assert(index < _m_num_of_layers);
+
+  if (_m_frozen_layers[index]) {
+    _m_frozen_layers[index] = false;
+    ResetGradients();
+  }
+}
+
+bool MultilayerPerceptron::IsLayerFrozen(size_t index) const {
+  assert(index < _m_num_of_layers);
+
+  return _m_frozen_layers[index];
+}
+
+namespace {
+
+// largest rank k with k * (m + n) < m * n
+size_t GetMaxUsefulRank(ssize_t rows, ssize_t cols) {
+  return static_cast<size_t>((rows * cols - 1) / (rows + cols));
+}
+
+// rounds up to whole cache lines of doubles if that stays within max_rank:
+// rows of V that don't fill a SIMD packet cost the kernels more than the
+// extra multiplications (see mlp-low-rank-benchmark)
+size_t RoundUpRank(size_t rank, size_t max_rank) {
+  constexpr size_t kMultiple = kCacheLineSize / sizeof(double);
+  size_t rounded = (rank + kMultiple - 1) / kMultiple * kMultiple;
+  return rounded <= max_rank ? rounded : rank;
+}
+
+// the first rank factors of svd, with the singular values split evenly
+// between them so both train at the same scale
+void GetFactors(const Eigen::BDCSVD<Matrix>& svd, size_t rank, Matrix& U,
+                Matrix& V) {
+  ssize_t k = static_cast<ssize_t>(rank);
+  Vector root = svd.singularValues().head(k).cwiseSqrt();
+
+  U = svd.matrixU().leftCols(k) * root.asDiagonal();
+  V = root.asDiagonal() * svd.matrixV().leftCols(k).transpose();
+}
+
+}  // namespace
+
+size_t MultilayerPerceptron::FactorizeLayer(size_t index,
+                                            const LowRankOptions& options) {
+  assert(index < _m_num_of_layers);
+  assert(options.energy > 0.0 && options.energy <= 1.0);
+
+  const MatrixMap& A = _m_linear_layers[index].GetARef();
+  size_t max_rank = GetMaxUsefulRank(A.rows(), A.cols());
+  if (options.max_rank > 0) {
+    max_rank = std::min(max_rank, options.max_rank);
+  }
+  if (max_rank == 0) {
+    return 0;
+  }
+
+  Eigen::BDCSVD<Matrix> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+  Vector energy = svd.singularValues().array().square();
+  double total = energy.sum();
+
+  size_t rank = 1;
+  double kept = energy[0];
+  while (rank < static_cast<size_t>(energy.size()) &&
+         kept < options.energy * total) {
+    kept += energy[static_cast<ssize_t>(rank++)];
+  }
+  if (rank > max_rank) {
+    return 0;
+  }
+  rank = RoundUpRank(rank, max_rank);
+
+  Matrix U, V;
+  GetFactors(svd, rank, U, V);
+  SplitLayer(index, U, V);
+  return rank;
+}
+
+size_t MultilayerPerceptron::FactorizeLayer(size_t index,
+                                            double max_accuracy_drop,
+                                            const DataSet& input,
+                                            const DataSet& output) {
+  assert(index < _m_num_of_layers);
+  assert(input.size() == output.size());
+
+  const MatrixMap& A = _m_linear_layers[index].GetARef();
+  size_t max_rank = GetMaxUsefulRank(A.rows(), A.cols());
+  if (max_rank == 0) {
+    return 0;
+  }
+
+  Eigen::BDCSVD<Matrix> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+  double min_accuracy = CalculateAccuracy(input, output) - max_accuracy_drop;
+
+  auto is_accurate = [&](size_t rank) {
+    MultilayerPerceptron candidate = *this;
+    Matrix U, V;
+    GetFactors(svd, rank, U, V);
+    candidate.SplitLayer(index, U, V);
+    return candidate.CalculateAccuracy(input, output) >= min_accuracy;
+  };
+
+  // accuracy grows with the rank, up to noise
+  if (!is_accurate(max_rank)) {
+    return 0;
+  }
+  size_t low = 1;
+  size_t high = max_rank;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (is_accurate(middle)) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+
+  size_t rank = RoundUpRank(low, max_rank);
+  Matrix U, V;
+  GetFactors(svd, rank, U, V);
+  SplitLayer(index, U, V);
+  return rank;
+}
+
+void MultilayerPerceptron::SplitLayer(size_t index, const Matrix& U,
+                                      const Matrix& V) {
+  std::vector<LinearLayer> linear_layers;
+  for (size_t i = 0; i < _m_num_of_layers; ++i) {
+    if (i != index) {
+      linear_layers.emplace_back(_m_linear_layers[i].GetARef(),
+                                 _m_linear_layers[i].GetbRef());
+      continue;
+    }
+    linear_layers.emplace_back(V, Vector::Zero(V.rows()));
+    linear_layers.emplace_back(U, _m_linear_layers[i].GetbRef());
+  }
+
+  auto position = static_cast<std::ptrdiff_t>(index);
+  _m_non_linear_layers.insert(
+      _m_non_linear_layers.begin() + position,
+      NonLinearLayer(ActivationFunctionsList().GetByName("identity")));
+  _m_frozen_layers.insert(_m_frozen_layers.begin() + position,
+                          static_cast<bool>(_m_frozen_layers[index]));
+  ++_m_num_of_layers;
+
+  _m_linear_layers = ParameterArena(linear_layers);
+  _m_gradients = MakeGradientArena();
+  _m_has_gradients = true;
+  FoldInputNormalization();
+}
+
+double MultilayerPerceptron::CalculateAccuracy(const DataSet& input,
+                                               const DataSet& output) const {
+  assert(input.size() == output.size());
+  if (input.empty()) {
+    return 0.0;
+  }
+
+  size_t correct = 0;
+  for (size_t i = 0; i < input.size(); ++i) {
+    Vector result = Calculate(to_Vector(input[i]));
+    Vector expected = to_Vector(output[i]);
+
+    ssize_t result_index = 0;
+    ssize_t expected_index = 0;
+    result.maxCoeff(&result_index);
+    expected.maxCoeff(&expected_index);
+    correct += result_index == expected_index;
+  }
+  return static_cast<double>(correct) / static_cast<double>(input.size());
+}
+
+void MultilayerPerceptron::SetInputNormalization(const Vector& scale,
+                                                 const Vector& offset) {
+  assert(scale.size() == _m_input_size);
+  assert(offset.size() == _m_input_size);
+
+  _m_input_scale = scale;
+  _m_input_offset = offset;
+  FoldInputNormalization();
+}
+
+void MultilayerPerceptron::ClearInputNormalization() {
+  _m_input_scale = Vector();
+  _m_input_offset = Vector();
+  FoldInputNormalization();
+}
+
+bool MultilayerPerceptron::HasInputNormalization() const {
+  return _m_input_scale.size() > 0;
+}
+
+const Vector& MultilayerPerceptron::GetInputScale() const {
+  return _m_input_scale;
+}
+
+const Vector& MultilayerPerceptron::GetInputOffset() const {
+  return _m_input_offset;
+}
+
+void MultilayerPerceptron::FoldInputNormalization() {
+  if (!HasInputNormalization() || _m_num_of_layers == 0) {
+    _m_input_layer = LinearLayer();
+    _m_input_layer_stale = false;
+    return;
+  }
+
+  const LinearLayer& first = _m_linear_layers[0];
+  if (_m_input_layer.GetInputSize() != first.GetInputSize() ||
+      _m_input_layer.GetOutputSize() != first.GetOutputSize()) {
+    _m_input_layer = LinearLayer(first.GetARef(), first.GetbRef());
+  }
+
+  // A (scale * raw + offset) + b = (A diag(scale)) raw + (A offset + b)
+  _m_input_layer.GetARef().noalias() =
+      first.GetARef() * _m_input_scale.asDiagonal();
+  _m_input_layer.GetbRef().noalias() =
+      first.GetARef() * _m_input_offset + first.GetbRef();
+  _m_input_layer_stale = false;
+}
+
+void MultilayerPerceptron::SetBatchSize(size_t size) {
+  assert(size > 0);
+
+  batch_size = size;
+}
+
+size_t MultilayerPerceptron::GetBatchSize() const {
+  return batch_size;
+}
+
+size_t MultilayerPerceptron::GetNumOfLayers() const {
+  return _m_num_of_layers;
+}
+
+ssize_t MultilayerPerceptron::GetInputSize() const {
+  return _m_input_size;
+}
+
+ssize_t MultilayerPerceptron::GetOutputSize() const {
+  return _m_output_size;
+}
+
+const LinearLayer& MultilayerPerceptron::GetLinearLayer(size_t index) const {
+  assert(index < _m_num_of_layers);
+
+  return _m_linear_layers[index];
+}
+
+const NonLinearLayer& MultilayerPerceptron::GetNonLinearLayer(
+    size_t index) const {
+  assert(index < _m_num_of_layers);
+
+  return _m_non_linear_layers[index];
+}
+
+void MultilayerPerceptron::SetFrozenPrefixCaching(bool enabled) {
+  _m_cache_frozen_prefix = enabled;
+}
+
+void MultilayerPerceptron::SetFastActivations(
+    bool enabled, const ActivationFunctionsList& act_list) {
+  const std::string prefix = "fast_";
+
+  for (auto& layer : _m_non_linear_layers) {
+    std::string name = layer.GetActivatioFunc().GetName();
+    bool is_fast = name.compare(0, prefix.size(), prefix) == 0;
+
+    std::string new_name = name;
+    if (enabled && !is_fast) {
+      new_name = prefix + name;
+    } else if (!enabled && is_fast) {
+      new_name = name.substr(prefix.size());
+    }
+
+    if (new_name != name && act_list.Contains(new_name)) {
+      layer = NonLinearLayer(act_list.GetByName(new_name));
+    }
+  }
+}
+
+size_t MultilayerPerceptron::GetFrozenPrefixSize() const {
+  size_t prefix = 0;
+  while (prefix < _m_num_of_layers && _m_frozen_layers[prefix]) {
+    ++prefix;
+  }
+  return prefix;
+}
+
+std::vector<Vector> MultilayerPerceptron::CalculateFrozenPrefix(
+    const DataSet& input) const {
+  size_t prefix = GetFrozenPrefixSize();
+
+  std::vector<Vector> cached(input.size());
+  for (size_t j = 0; j < input.size(); ++j) {
+    cached[j] = CalculateLayers(to_Vector(input[j]), 0, prefix);
+  }
+  return cached;
+}
+
+GradientArena MultilayerPerceptron::MakeGradientArena() const {
+  return GradientArena(_m_linear_layers, GetFrozenPrefixSize());
+}
+
+void MultilayerPerceptron::ResetGradients() {
+  if (!_m_has_gradients) {
+    return;
+  }
+
+  GradientArena gradients = MakeGradientArena();
+
+  // keep what was accumulated for the layers that stay trainable
+  size_t begin = std::max(gradients.GetOffset(), _m_gradients.GetOffset());
+  size_t end = _m_linear_layers.GetSize();
+  if (_m_gradients.GetSize() > 0 && begin < end) {
+    std::copy(_m_gradients.GetData() + (begin - _m_gradients.GetOffset()),
+              _m_gradients.GetData() + (end - _m_gradients.GetOffset()),
+              gradients.GetData() + (begin - gradients.GetOffset()));
+  }
+
+  for (size_t i = gradients.GetFirstLayer(); i < _m_num_of_layers; ++i) {
+    if (_m_frozen_layers[i]) {
+      gradients.GetLayers()[i].Clear();
+    }
+  }
+  _m_gradients = std::move(gradients);
+}
+
+void MultilayerPerceptron::EnsureGradients() {
+  if (!_m_has_gradients) {
+    _m_gradients = MakeGradientArena();
+    _m_has_gradients = true;
+  }
+}
+
+void MultilayerPerceptron::ReleaseGradients() {
+  _m_gradients = GradientArena();
+  _m_has_gradients = false;
+}
+
+MultilayerPerceptron MultilayerPerceptron::CopyWithoutGradients() const {
+  MultilayerPerceptron copy;
+  copy._m_num_of_layers = _m_num_of_layers;
+  copy._m_input_size = _m_input_size;
+  copy._m_output_size = _m_output_size;
+  copy._m_linear_layers = _m_linear_layers;
+  copy._m_non_linear_layers = _m_non_linear_layers;
+  copy._m_frozen_layers = _m_frozen_layers;
+  copy._m_input_scale = _m_input_scale;
+  copy._m_input_offset = _m_input_offset;
+  copy._m_input_layer = _m_input_layer;
+  copy._m_cache_frozen_prefix = _m_cache_frozen_prefix;
+  copy._m_loss = _m_loss;
+  copy._m_update_callback = _m_update_callback;
+  copy.batch_size = batch_size;
+  if (_m_input_layer_stale) {
+    copy.FoldInputNormalization();
+  }
+  return copy;
+}
+
+size_t MultilayerPerceptron::GetMemoryUsage() const {
+  size_t folded = static_cast<size_t>(_m_input_layer.GetARef().size() +
+                                      _m_input_layer.GetbRef().size());
+  return (_m_linear_layers.GetSize() + _m_gradients.GetSize() + folded) *
+         sizeof(double);
+}
+
 void MultilayerPerceptron::MultilayerPerceptron::Train(size_t num_of_iterations,
                                                        const DataSet& input,
                                                        const DataSet& output) {
+  size_t prefix = GetFrozenPrefixSize();
+  if (prefix == _m_num_of_layers) {
+    return;
+  }
+  EnsureGradients();
+
+  // output of the frozen layers doesn't change between epochs
+  std::vector<Vector> cached;
+  if (prefix > 0 && _m_cache_frozen_prefix) {
+    cached = CalculateFrozenPrefix(input);
+  } else {
+    prefix = 0;
+  }
+
   for (size_t it = 0; it < num_of_iterations; ++it) {
     for (size_t i = 0; i < input.size(); i += batch_size) {
       size_t r = std::min(i + batch_size, input.size());
 
       // train on batch
       for (size_t j = i; j < r; ++j) {
-        TrainOnOneSample(to_Vector(input[j]), to_Vector(output[j]));
+        if (prefix > 0) {
+          AccumulateGradients(cached[j], to_Vector(output[j]),
+                              _m_gradients.GetLayers(), prefix);
+        } else {
+          TrainOnOneSample(to_Vector(input[j]), to_Vector(output[j]));
+        }
       }
 
       UpdateParameters();
     }
   }
+  FoldInputNormalization();
+}
+
+void MultilayerPerceptron::Train(size_t num_of_iterations,
+                                 SampleSource& source) {
+  assert(source.GetInputSize() == _m_input_size);
+  assert(source.GetOutputSize() == _m_output_size);
+
+  if (GetFrozenPrefixSize() == _m_num_of_layers) {
+    return;
+  }
+
+  Vector input, output;
+  for (size_t it = 0; it < num_of_iterations; ++it) {
+    source.Reset();
+
+    size_t samples_in_batch = 0;
+    while (source.Next(input, output)) {
+      TrainOnOneSample(input, output);
+      if (++samples_in_batch == batch_size) {
+        UpdateParameters();
+        samples_in_batch = 0;
+      }
+    }
+    if (samples_in_batch > 0) {
+      UpdateParameters();
+    }
+  }
+  FoldInputNormalization();
+}
+
+void MultilayerPerceptron::Train(size_t num_of_iterations,
+                                 const FeatureBatch<uint8_t>& input,
+                                 const DataSet& output) {
+  TrainRaw(num_of_iterations, input, output);
+}
+
+void MultilayerPerceptron::Train(size_t num_of_iterations,
+                                 const FeatureBatch<int16_t>& input,
+                                 const DataSet& output) {
+  TrainRaw(num_of_iterations, input, output);
+}
+
+template <typename T>
+void MultilayerPerceptron::TrainRaw(size_t num_of_iterations,
+                                    const FeatureBatch<T>& input,
+                                    const DataSet& output) {
+  CheckInputNormalization();
+  assert(input.num_of_features == static_cast<size_t>(_m_input_size));
+  assert(input.size() == output.size());
+
+  size_t prefix = GetFrozenPrefixSize();
+  if (prefix == _m_num_of_layers) {
+    return;
+  }
+  EnsureGradients();
+
+  std::vector<Vector> cached;
+  if (prefix > 0 && _m_cache_frozen_prefix) {
+    cached.resize(input.size());
+    for (size_t j = 0; j < input.size(); ++j) {
+      cached[j] = CalculateLayers(Normalize(input[j]), 0, prefix);
+    }
+  } else {
+    prefix = 0;
+  }
+
+  for (size_t it = 0; it < num_of_iterations; ++it) {
+    for (size_t i = 0; i < input.size(); i += batch_size) {
+      size_t r = std::min(i + batch_size, input.size());
+
+      for (size_t j = i; j < r; ++j) {
+        if (prefix > 0) {
+          AccumulateGradients(cached[j], to_Vector(output[j]),
+                              _m_gradients.GetLayers(), prefix);
+        } else {
+          TrainOnOneSample(Normalize(input[j]), to_Vector(output[j]));
+        }
+      }
+
+      UpdateParameters();
+    }
+  }
+  FoldInputNormalization();
+}
+
+void MultilayerPerceptron::TrainAsync(size_t num_of_iterations,
+                                      const DataSet& input,
+                                      const DataSet& output,
+                                      const AsyncTrainingOptions& options) {
+  assert(input.size() == output.size());
+  assert(options.num_of_threads > 0);
+  assert(options.local_batch_size > 0);
+
+  std::unique_ptr<ThreadPool> own_pool;
+  ThreadPool* pool = options.pool;
+  size_t num_of_threads = std::min(options.num_of_threads, input.size());
+  if (pool != nullptr) {
+    num_of_threads = std::min(num_of_threads, pool->GetNumOfThreads());
+  }
+  size_t prefix = GetFrozenPrefixSize();
+  if (num_of_threads == 0 || prefix == _m_num_of_layers) {
+    return;
+  }
+
+  std::vector<Vector> cached;
+  if (prefix > 0 && _m_cache_frozen_prefix) {
+    cached = CalculateFrozenPrefix(input);
+  } else {
+    prefix = 0;
+  }
+
+  // clocks[w] = number of updates worker w has applied, used only by the
+  // bounded staleness mode; finished workers stop holding the others back
+  constexpr size_t kFinished = std::numeric_limits<size_t>::max();
+  std::vector<std::atomic<size_t>> clocks(num_of_threads);
+  for (auto& clock : clocks) {
+    clock.store(0);
+  }
+
+  auto wait_for_slowest = [&](size_t worker) {
+    size_t own = clocks[worker].load(std::memory_order_relaxed);
+    while (true) {
+      size_t slowest = kFinished;
+      for (const auto& clock : clocks) {
+        slowest = std::min(slowest, clock.load(std::memory_order_acquire));
+      }
+      if (own <= slowest + options.max_staleness) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+  };
+
+  // every worker copies the model before any of them writes to it
+  std::atomic<size_t> num_of_copies{0};
+
+  auto worker_loop = [&](size_t worker) {
+    // Reads go to a private copy of the parameters, the kernels can't read
+    // the shared ones atomically. Like the gradients, the copy is first
+    // touched by the worker, so allocated on its node.
+    MultilayerPerceptron local = CopyWithoutGradients();
+    num_of_copies.fetch_add(1, std::memory_order_release);
+    while (num_of_copies.load(std::memory_order_acquire) < num_of_threads) {
+      std::this_thread::yield();
+    }
+
+    GradientArena gradients = local.MakeGradientArena();
+    std::vector<DeltaLinearLayer>& deltas = gradients.GetLayers();
+
+    // every worker owns a fixed slice of the data set
+    size_t begin = input.size() * worker / num_of_threads;
+    size_t end = input.size() * (worker + 1) / num_of_threads;
+
+    std::vector<Vector> local_input;
+    std::vector<Vector> local_output;
+    if (options.place_data_on_workers) {
+      for (size_t j = begin; j < end; ++j) {
+        local_input.push_back(prefix > 0 ? cached[j] : to_Vector(input[j]));
+        local_output.push_back(to_Vector(output[j]));
+      }
+    }
+
+    for (size_t it = 0; it < num_of_iterations; ++it) {
+      for (size_t i = begin; i < end; i += options.local_batch_size) {
+        size_t r = std::min(i + options.local_batch_size, end);
+
+        for (size_t j = i; j < r; ++j) {
+          if (options.place_data_on_workers) {
+            local.AccumulateGradients(local_input[j - begin],
+                                      local_output[j - begin], deltas, prefix);
+          } else if (prefix > 0) {
+            local.AccumulateGradients(cached[j], to_Vector(output[j]), deltas,
+                                      prefix);
+          } else {
+            local.AccumulateGradients(to_Vector(input[j]),
+                                      to_Vector(output[j]), deltas);
+          }
+        }
+
+        if (options.max_staleness > 0) {
+          wait_for_slowest(worker);
+        }
+
+        // Hogwild: workers write into the shared weights without locks, a
+        // lost update only slightly perturbs SGD. Step is scaled by
+        // batch_size so a sample weighs the same as in Train.
+        ApplySharedGradients(gradients, local);
+
+        clocks[worker].fetch_add(1, std::memory_order_release);
+      }
+    }
+
+    clocks[worker].store(kFinished, std::memory_order_release);
+  };
+
+  if (pool == nullptr) {
+    own_pool = std::make_unique<ThreadPool>(num_of_threads, options.affinity);
+    pool = own_pool.get();
+  }
+
+  // one worker per thread, the bounded staleness mode needs them all running
+  TaskGroup group(*pool);
+  for (size_t w = 0; w < num_of_threads; ++w) {
+    group.SubmitTo(w, [&worker_loop, w] { worker_loop(w); });
+  }
+  group.Wait();
+
+  FoldInputNormalization();
 }
 
 template <typename T>
@@ -127,6 +877,73 @@ void ReadFromStream(std::istream& in, T& x) {
   in.read(reinterpret_cast<char*>(&x), sizeof(x));
 }
 
+namespace {
+
+// "MLPN", starts the input normalization trailer of a model file
+constexpr uint32_t kInputNormalizationMagic = 0x4e504c4d;
+
+void WriteVector(std::ostream& out, const Vector& v) {
+  out.write(reinterpret_cast<const char*>(v.data()),
+            static_cast<std::streamsize>(v.size() * sizeof(double)));
+}
+
+Vector ReadVector(std::istream& in, size_t size) {
+  Vector v(static_cast<ssize_t>(size));
+  in.read(reinterpret_cast<char*>(v.data()),
+          static_cast<std::streamsize>(size * sizeof(double)));
+  return v;
+}
+
+}  // namespace
+
+Eigen::Map<Vector> MultilayerPerceptron::GetParameterSpan() {
+  // the caller may write to it
+  _m_input_layer_stale = true;
+  return Eigen::Map<Vector>(_m_linear_layers.GetData(),
+                            static_cast<ssize_t>(_m_linear_layers.GetSize()));
+}
+
+Eigen::Map<Vector> MultilayerPerceptron::GetGradientSpan() {
+  EnsureGradients();
+  return Eigen::Map<Vector>(_m_gradients.GetData(),
+                            static_cast<ssize_t>(_m_gradients.GetSize()));
+}
+
+size_t MultilayerPerceptron::GetGradientOffset() const {
+  return _m_gradients.GetOffset();
+}
+
+void MultilayerPerceptron::SaveCheckpoint(const std::string& file_path) const {
+  std::ofstream out(file_path, std::ios::binary);
+
+  WriteInStream(out, _m_linear_layers.GetSize());
+  out.write(reinterpret_cast<const char*>(_m_linear_layers.GetData()),
+            static_cast<std::streamsize>(_m_linear_layers.GetSize() *
+                                         sizeof(double)));
+}
+
+bool MultilayerPerceptron::LoadCheckpoint(const std::string& file_path) {
+  std::ifstream in(file_path, std::ios::binary);
+
+  size_t size = 0;
+  ReadFromStream(in, size);
+  if (!in || size != _m_linear_layers.GetSize()) {
+    return false;
+  }
+
+  // read into a copy, so a truncated file leaves the model as it was
+  ParameterBuffer parameters(size);
+  in.read(reinterpret_cast<char*>(parameters.data()),
+          static_cast<std::streamsize>(size * sizeof(double)));
+  if (!in) {
+    return false;
+  }
+
+  std::copy(parameters.begin(), parameters.end(), _m_linear_layers.GetData());
+  FoldInputNormalization();
+  return true;
+}
+
 void MultilayerPerceptron::SaveModel(const std::string& file_path) const {
   std::ofstream out(file_path, std::ios::binary);
 
@@ -140,27 +957,73 @@ void MultilayerPerceptron::SaveModel(const std::string& file_path) const {
   }
 
   WriteLossFunction(out, _m_loss);
+
+  // optional trailer, older files end after the loss
+  if (HasInputNormalization()) {
+    WriteInStream(out, kInputNormalizationMagic);
+    WriteInStream(out, static_cast<size_t>(_m_input_size));
+    WriteVector(out, _m_input_scale);
+    WriteVector(out, _m_input_offset);
+  }
 }
 
-void MultilayerPerceptron::LoadModel(const std::string& file_path,
+bool MultilayerPerceptron::LoadModel(const std::string& file_path,
                                      const ActivationFunctionsList& act_list,
                                      const LossFunctionsList& los_list) {
   std::ifstream in(file_path, std::ios::binary);
 
-  ReadFromStream(in, _m_num_of_layers);
-  ReadFromStream(in, _m_input_size);
-  ReadFromStream(in, _m_output_size);
+  size_t num_of_layers = 0;
+  ssize_t input_size = 0;
+  ssize_t output_size = 0;
+  ReadFromStream(in, num_of_layers);
+  ReadFromStream(in, input_size);
+  ReadFromStream(in, output_size);
 
-  for (size_t i = 0; i < _m_num_of_layers; ++i) {
-    _m_linear_layers.push_back(ReadLinearLayer(in));
-    _m_non_linear_layers.emplace_back(ReadActivationFunction(in, act_list));
-
-    ssize_t input_size = _m_linear_layers[i].GetInputSize();
-    ssize_t output_size = _m_linear_layers[i].GetOutputSize();
-    _m_delta_linear_layers.emplace_back(input_size, output_size);
+  // read into locals, so a corrupt file leaves the model as it was
+  std::vector<LinearLayer> linear_layers;
+  std::vector<NonLinearLayer> non_linear_layers;
+  ssize_t size = input_size;
+  for (size_t i = 0; i < num_of_layers && in; ++i) {
+    linear_layers.push_back(ReadLinearLayer(in));
+    non_linear_layers.emplace_back(ReadActivationFunction(in, act_list));
+    if (linear_layers.back().GetARef().cols() != size) {
+      in.setstate(std::ios::failbit);
+    }
+    size = linear_layers.back().GetARef().rows();
   }
+  LossFunction loss = ReadLossFunction(in, los_list);
+  if (!in || num_of_layers == 0 || size != output_size) {
+    return false;
+  }
+
+  _m_num_of_layers = num_of_layers;
+  _m_input_size = input_size;
+  _m_output_size = output_size;
+  _m_linear_layers = ParameterArena(linear_layers);
+  _m_non_linear_layers = std::move(non_linear_layers);
+  _m_frozen_layers.assign(_m_num_of_layers, false);
+  _m_loss = loss;
+  // training allocates them
+  _m_gradients = GradientArena();
+  _m_has_gradients = false;
 
-  ReadLossFunction(in, los_list);
+  _m_input_scale = Vector();
+  _m_input_offset = Vector();
+  uint32_t magic = 0;
+  size_t normalization_size = 0;
+  ReadFromStream(in, magic);
+  ReadFromStream(in, normalization_size);
+  if (in && magic == kInputNormalizationMagic &&
+      normalization_size == static_cast<size_t>(_m_input_size)) {
+    Vector scale = ReadVector(in, normalization_size);
+    Vector offset = ReadVector(in, normalization_size);
+    if (in) {
+      _m_input_scale = scale;
+      _m_input_offset = offset;
+    }
+  }
+  FoldInputNormalization();
+  return true;
 }
 
 }  // namespace mlp
@@ -1,11 +1,18 @@
+#pragma once
+
 #include <stdio.h>
 #include <cassert>
+#include <functional>
 #include <initializer_list>
 #include <vector>
 
+#include "../src/feature_batch.h"
+#include "../src/idx.h"
 #include "../src/linear_layer.h"
 #include "../src/loss_func.h"
 #include "../src/non_linear_layer.h"
+#include "../src/sharded_dataset.h"
+#include "../src/thread_pool.h"
 
 namespace mlp {
 
@@ -13,6 +20,38 @@ using Matrix = Eigen::MatrixXd;
 using Vector = Eigen::VectorXd;
 using DataSet = std::vector<std::vector<double>>;
 
+struct AsyncTrainingOptions {
+  // number of worker threads writing into the shared weights
+  size_t num_of_threads = 1;
+
+  // samples a worker accumulates before applying them to the shared weights
+  size_t local_batch_size = 1;
+
+  // how many local updates the fastest worker may be ahead of the slowest
+  // one, 0 means unbounded (pure Hogwild)
+  size_t max_staleness = 0;
+
+  // pinning of the workers, they spread over the NUMA nodes
+  ThreadAffinity affinity = ThreadAffinity::kNone;
+
+  // runs the workers on this pool instead of a new one with num_of_threads
+  // and affinity, at most one worker per thread of the pool
+  ThreadPool* pool = nullptr;
+
+  // every worker copies its slice of the data set once, so it is read from
+  // the memory of the worker's node (and not converted every epoch)
+  bool place_data_on_workers = false;
+};
+
+struct LowRankOptions {
+  // keep the smallest rank whose singular values hold at least this fraction
+  // of the energy (squared Frobenius norm) of A, before rounding it up
+  double energy = 0.99;
+
+  // upper bound of the rank, 0 means none
+  size_t max_rank = 0;
+};
+
 class MultilayerPerceptron {
  public:
   MultilayerPerceptron() = default;
@@ -22,31 +61,240 @@ class MultilayerPerceptron {
       const std::initializer_list<ActivationFunction>& act_funcs,
       LossFunction loss_func);
 
+  MultilayerPerceptron(const std::vector<ssize_t>& dimensions,
+                       const std::vector<ActivationFunction>& act_funcs,
+                       LossFunction loss_func);
+
   Vector Calculate(const Vector& input) const;
 
+  // Raw features, GetInputSize() of them, of a model with an input
+  // normalization. The first layer reads them directly through its folded
+  // weights, skipping zero features. Throws std::logic_error without an
+  // input normalization, as do the other raw overloads.
+  Vector Calculate(const uint8_t* raw) const;
+
+  Vector Calculate(const int16_t* raw) const;
+
   void TrainOnOneSample(const Vector& input, const Vector& output);
 
+  // normalizes the raw features on the fly
+  void TrainOnOneSample(const uint8_t* raw, const Vector& output);
+
+  void TrainOnOneSample(const int16_t* raw, const Vector& output);
+
   void UpdateParameters();
 
+  // Called on the training thread after every UpdateParameters (and so
+  // every batch of Train), e.g. with ModelHandle::MakePublisher to serve the
+  // model while it trains. TrainAsync doesn't call it. Copies of the model
+  // keep the callback.
+  void SetUpdateCallback(
+      std::function<void(const MultilayerPerceptron&)> callback);
+
   void Train(size_t num_of_iterations, const DataSet& input,
              const DataSet& output);
 
+  // Streams every epoch from the source, so the samples don't have to fit
+  // in memory (see ShardedDataSetReader).
+  void Train(size_t num_of_iterations, SampleSource& source);
+
+  // raw features, normalized on the fly
+  void Train(size_t num_of_iterations, const FeatureBatch<uint8_t>& input,
+             const DataSet& output);
+
+  void Train(size_t num_of_iterations, const FeatureBatch<int16_t>& input,
+             const DataSet& output);
+
+  // Hogwild SGD: the workers update the shared parameters without locks,
+  // with relaxed atomic loads and stores, so updates may be lost but never
+  // torn. Every worker computes its gradients on a private copy of the
+  // parameters, refreshed whenever it applies a local batch. Don't Calculate
+  // on the model from another thread meanwhile.
+  //
+  // Every worker accumulates its gradients in buffers it allocates itself,
+  // so with pinned workers they are on the worker's NUMA node. Must not be
+  // called from a worker of options.pool.
+  void TrainAsync(size_t num_of_iterations, const DataSet& input,
+                  const DataSet& output, const AsyncTrainingOptions& options);
+
+  // Frozen layers keep their weights: the frozen prefix gets no gradient
+  // buffers and backpropagation stops at the first trainable layer.
+  void FreezeLayer(size_t index);
+
+  void UnfreezeLayer(size_t index);
+
+  bool IsLayerFrozen(size_t index) const;
+
+  // When the first layers are frozen, Train computes their output once per
+  // data set instead of once per sample and epoch (enabled by default).
+  void SetFrozenPrefixCaching(bool enabled);
+
+  // Switches every sigmoid, tanh and softmax layer to its "fast_" version
+  // from act_list (exp approximated by kernels::ExpApprox) or back to the
+  // exact one. Layers without a counterpart in act_list are kept.
+  void SetFastActivations(
+      bool enabled,
+      const ActivationFunctionsList& act_list = ActivationFunctionsList());
+
+  // Replaces layer index, A of m x n, with the rank k truncated SVD U * V as
+  // two layers: V (k x n) with the "identity" activation and U (m x k) with
+  // the b and the activation of the original layer; k is rounded up to a
+  // multiple of 8 when that stays cheaper. Calculate then costs
+  // k * (m + n) instead of m * n multiplications. The factors are ordinary
+  // layers, so Train fine-tunes them and SaveModel stores them; they are
+  // frozen if the original layer was. Later layers move up by one index and
+  // the accumulated gradients are dropped.
+  // Returns k, or 0 (and keeps the model) if the factors aren't cheaper.
+  size_t FactorizeLayer(size_t index, const LowRankOptions& options = {});
+
+  // The same with the smallest rank whose accuracy (the argmax of the output
+  // matches the one of output) on the data set is at most max_accuracy_drop
+  // below the accuracy of the model.
+  size_t FactorizeLayer(size_t index, double max_accuracy_drop,
+                        const DataSet& input, const DataSet& output);
+
+  // fraction of samples whose output has the argmax of the expected one
+  double CalculateAccuracy(const DataSet& input, const DataSet& output) const;
+
+  // The model input is scale * raw + offset (per feature) of raw integer
+  // features. Calculate of raw features uses the first layer with the
+  // normalization folded in, A * diag(scale) and b + A * offset. It is
+  // refolded at the end of every Train and before the update callback, not
+  // after every update: until then (e.g. after UpdateParameters or writing to
+  // GetParameterSpan) raw features are normalized and go through the first
+  // layer itself. SaveModel stores the normalization.
+  void SetInputNormalization(const Vector& scale, const Vector& offset);
+
+  void ClearInputNormalization();
+
+  bool HasInputNormalization() const;
+
+  const Vector& GetInputScale() const;
+
+  const Vector& GetInputOffset() const;
+
+  void SetBatchSize(size_t size);
+
+  size_t GetBatchSize() const;
+
+  size_t GetNumOfLayers() const;
+
+  ssize_t GetInputSize() const;
+
+  ssize_t GetOutputSize() const;
+
+  const LinearLayer& GetLinearLayer(size_t index) const;
+
+  const NonLinearLayer& GetNonLinearLayer(size_t index) const;
+
+  // All parameters as one flat span: A (column-major) and b of every layer,
+  // each padded to a cache line. The folded first layer counts as stale
+  // afterwards (see SetInputNormalization).
+  Eigen::Map<Vector> GetParameterSpan();
+
+  // Gradients accumulated since the last update as one flat span laid out
+  // like the parameters from GetGradientOffset() on, e.g. for reducing them
+  // across processes before UpdateParameters.
+  Eigen::Map<Vector> GetGradientSpan();
+
+  size_t GetGradientOffset() const;
+
+  // Frees the gradient buffers of a model used only for Calculate, halving
+  // its memory. Training allocates them again.
+  void ReleaseGradients();
+
+  // A copy of the model as ReleaseGradients leaves it, without copying the
+  // gradient buffers first.
+  MultilayerPerceptron CopyWithoutGradients() const;
+
+  // bytes of the parameter and gradient buffers (and the folded first layer)
+  size_t GetMemoryUsage() const;
+
+  // The parameter span in a single write. A checkpoint loads only into a
+  // model of the same shape, SaveModel writes a self-contained file.
+  void SaveCheckpoint(const std::string& file_path) const;
+
+  // false if the file doesn't match the shape of the model
+  bool LoadCheckpoint(const std::string& file_path);
+
   void SaveModel(const std::string& file_path) const;
 
-  void LoadModel(const std::string& file_path,
+  // Without gradient buffers, training allocates them. False on a file that
+  // can't be read or doesn't hold a model saved by SaveModel, which leaves
+  // the model as it was.
+  bool LoadModel(const std::string& file_path,
                  const ActivationFunctionsList& act_list,
                  const LossFunctionsList& los_list);
 
  private:
-  size_t _m_num_of_layers;
-  ssize_t _m_input_size;
-  ssize_t _m_output_size;
-  std::vector<LinearLayer> _m_linear_layers;
-  std::vector<DeltaLinearLayer> _m_delta_linear_layers;
+  // input is the output of layer first_layer - 1 (or the model input)
+  void AccumulateGradients(const Vector& input, const Vector& output,
+                           std::vector<DeltaLinearLayer>& deltas,
+                           size_t first_layer = 0) const;
+
+  Vector CalculateLayers(const Vector& input, size_t begin, size_t end) const;
+
+  size_t GetFrozenPrefixSize() const;
+
+  std::vector<Vector> CalculateFrozenPrefix(const DataSet& input) const;
+
+  GradientArena MakeGradientArena() const;
+
+  // replaces layer index with V followed by U, see FactorizeLayer
+  void SplitLayer(size_t index, const Matrix& U, const Matrix& V);
+
+  // rebuilds the gradients after the frozen layers changed
+  void ResetGradients();
+
+  // allocates the gradients again after ReleaseGradients
+  void EnsureGradients();
+
+  // throws std::logic_error without an input normalization
+  void CheckInputNormalization() const;
+
+  // scale * raw + offset
+  template <typename T>
+  Vector Normalize(const T* raw) const;
+
+  template <typename T>
+  Vector CalculateRaw(const T* raw) const;
+
+  template <typename T>
+  void TrainRaw(size_t num_of_iterations, const FeatureBatch<T>& input,
+                const DataSet& output);
+
+  // recomputes _m_input_layer from the first layer
+  void FoldInputNormalization();
+
+  // one pass: parameters -= gradients / batch_size, gradients = 0
+  void ApplyGradients(GradientArena& gradients);
+
+  // ApplyGradients for concurrent workers with relaxed atomics; local gets
+  // the values written
+  void ApplySharedGradients(GradientArena& gradients,
+                            MultilayerPerceptron& local);
+
+  size_t _m_num_of_layers = 0;
+  ssize_t _m_input_size = 0;
+  ssize_t _m_output_size = 0;
+  ParameterArena _m_linear_layers;
+  GradientArena _m_gradients;
+  bool _m_has_gradients = false;
   std::vector<NonLinearLayer> _m_non_linear_layers;
+  std::vector<bool> _m_frozen_layers;
+
+  // empty without an input normalization
+  Vector _m_input_scale;
+  Vector _m_input_offset;
+  LinearLayer _m_input_layer;
+  // the parameters changed since the last fold
+  bool _m_input_layer_stale = false;
+  bool _m_cache_frozen_prefix = true;
 
   LossFunction _m_loss;
 
+  std::function<void(const MultilayerPerceptron&)> _m_update_callback;
+
   size_t batch_size = 200;
 };
 
@@ -0,0 +1,66 @@
+#include "model_handle.h"
+
+#include <utility>
+
+namespace mlp {
+
+ModelHandle::ModelHandle(const MultilayerPerceptron& model) {
+  Publish(model);
+}
+
+void ModelHandle::Publish(const MultilayerPerceptron& model) {
+  // readers only Calculate
+  Publish(std::make_shared<MultilayerPerceptron>(model.CopyWithoutGradients()));
+}
+
+void ModelHandle::Publish(std::shared_ptr<const MultilayerPerceptron> model) {
+  assert(model);
+
+  // the pointer first, so a reader that sees the new version finds at least
+  // this model; the old one is released outside of the swap
+  std::atomic_store(&_model, std::move(model));
+  _version.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<const MultilayerPerceptron> ModelHandle::Get() const {
+  return std::atomic_load(&_model);
+}
+
+uint64_t ModelHandle::GetVersion() const {
+  return _version.load(std::memory_order_acquire);
+}
+
+std::function<void(const MultilayerPerceptron&)> ModelHandle::MakePublisher(
+    size_t num_of_updates) {
+  assert(num_of_updates > 0);
+
+  size_t count = 0;
+  return [this, num_of_updates, count](
+             const MultilayerPerceptron& model) mutable {
+    if (++count == num_of_updates) {
+      Publish(model);
+      count = 0;
+    }
+  };
+}
+
+ModelHandle::Reader::Reader(const ModelHandle& handle) : _handle(&handle) {
+  Get();
+}
+
+const MultilayerPerceptron& ModelHandle::Reader::Get() {
+  uint64_t version = _handle->GetVersion();
+  if (version != _version) {
+    // may already be a newer model than version, then the next Get takes
+    // it again
+    _model = _handle->Get();
+    _version = version;
+  }
+  return *_model;
+}
+
+uint64_t ModelHandle::Reader::GetVersion() const {
+  return _version;
+}
+
+}  // namespace mlp
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "mlp.h"
+
+namespace mlp {
+
+// Shares the current version of a model between a trainer and concurrent
+// readers. Published models are immutable snapshots: a reader keeps using
+// the one it got while newer ones are published, and a snapshot is freed
+// when its last reader moves on.
+class ModelHandle {
+ public:
+  explicit ModelHandle(const MultilayerPerceptron& model);
+
+  // makes a copy of model without its gradients the current version
+  void Publish(const MultilayerPerceptron& model);
+
+  void Publish(std::shared_ptr<const MultilayerPerceptron> model);
+
+  std::shared_ptr<const MultilayerPerceptron> Get() const;
+
+  // incremented by every Publish, starts at 1
+  uint64_t GetVersion() const;
+
+  // For MultilayerPerceptron::SetUpdateCallback: publishes the trained model
+  // after every num_of_updates parameter updates.
+  std::function<void(const MultilayerPerceptron&)> MakePublisher(
+      size_t num_of_updates);
+
+  // Per-thread view of the handle. Get costs one atomic load while the
+  // version doesn't change and never waits for the trainer; only the first
+  // Get after a Publish takes the shared_ptr of the new version.
+  class Reader {
+   public:
+    explicit Reader(const ModelHandle& handle);
+
+    // valid until the next Get of this reader
+    const MultilayerPerceptron& Get();
+
+    uint64_t GetVersion() const;
+
+   private:
+    const ModelHandle* _handle;
+    uint64_t _version = 0;
+    std::shared_ptr<const MultilayerPerceptron> _model;
+  };
+
+ private:
+  // accessed only through std::atomic_load/atomic_store
+  std::shared_ptr<const MultilayerPerceptron> _model;
+  std::atomic<uint64_t> _version{0};
+};
+
+}  // namespace mlp
@@ -0,0 +1,131 @@
+#include "model_registry.h"
+
+#include <exception>
+#include <fstream>
+#include <utility>
+
+namespace mlp {
+
+ModelRegistry::ModelRegistry(const ModelRegistryOptions& options,
+                             const ActivationFunctionsList& act_list,
+                             const LossFunctionsList& loss_list)
+    : _options(options), _act_list(act_list), _loss_list(loss_list) {}
+
+void ModelRegistry::Register(const std::string& name,
+                             const std::string& file_path) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _paths[name] = file_path;
+}
+
+std::shared_ptr<const MultilayerPerceptron> ModelRegistry::Get(
+    const std::string& name) {
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  // models are cached by path, so a name and its path share the entry
+  auto path = _paths.find(name);
+  std::string file_path = path == _paths.end() ? name : path->second;
+
+  auto it = _entries.find(file_path);
+  if (it != _entries.end()) {
+    ++_stats.hits;
+    if (it->second.loaded) {
+      _lru.splice(_lru.begin(), _lru, it->second.lru_position);
+    }
+    // waits outside of the lock if another thread is still loading it
+    std::shared_future<ModelPtr> model = it->second.model;
+    lock.unlock();
+    return model.get();
+  }
+
+  ++_stats.misses;
+  std::promise<ModelPtr> promise;
+  _entries[file_path].model = promise.get_future().share();
+  lock.unlock();
+
+  ModelPtr model;
+  try {
+    model = Load(file_path);
+  } catch (...) {
+    // the waiting Gets get the exception too, and a later Get tries again
+    lock.lock();
+    _entries.erase(file_path);
+    lock.unlock();
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  lock.lock();
+  it = _entries.find(file_path);
+  if (!model) {
+    // not cached, so a later Get tries again
+    _entries.erase(it);
+  } else {
+    it->second.loaded = true;
+    it->second.memory_usage = model->GetMemoryUsage();
+    it->second.lru_position = _lru.insert(_lru.begin(), file_path);
+    _stats.memory_usage += it->second.memory_usage;
+    ++_stats.num_of_models;
+    EvictOverBudget(file_path);
+  }
+  lock.unlock();
+
+  promise.set_value(model);
+  return model;
+}
+
+bool ModelRegistry::Evict(const std::string& name) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto path = _paths.find(name);
+  auto it = _entries.find(path == _paths.end() ? name : path->second);
+  if (it == _entries.end() || !it->second.loaded) {
+    return false;
+  }
+  Erase(it);
+  return true;
+}
+
+ModelRegistryStats ModelRegistry::GetStats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+ModelRegistry::ModelPtr ModelRegistry::Load(
+    const std::string& file_path) const {
+  // LoadModel doesn't allocate gradients, nor more than the file holds
+  auto model = std::make_shared<MultilayerPerceptron>();
+  if (!model->LoadModel(file_path, _act_list, _loss_list)) {
+    return nullptr;
+  }
+  return model;
+}
+
+void ModelRegistry::EvictOverBudget(const std::string& keep) {
+  if (_options.memory_budget == 0) {
+    return;
+  }
+
+  auto victim = _lru.end();
+  while (_stats.memory_usage > _options.memory_budget &&
+         victim != _lru.begin()) {
+    --victim;
+    if (*victim == keep) {
+      continue;
+    }
+    auto it = _entries.find(*victim);
+    // Erase keeps iterators to the other elements valid
+    ++victim;
+    Erase(it);
+    ++_stats.evictions;
+  }
+}
+
+void ModelRegistry::Erase(
+    std::unordered_map<std::string, Entry>::iterator it) {
+  _stats.memory_usage -= it->second.memory_usage;
+  --_stats.num_of_models;
+  _lru.erase(it->second.lru_position);
+  _entries.erase(it);
+}
+
+}  // namespace mlp
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "mlp.h"
+
+namespace mlp {
+
+struct ModelRegistryOptions {
+  // bound of the total GetMemoryUsage of the cached models, 0 means none
+  size_t memory_budget = 0;
+};
+
+struct ModelRegistryStats {
+  // Get of a cached model or of one another thread is loading
+  size_t hits = 0;
+
+  // Get that loaded the model
+  size_t misses = 0;
+
+  size_t evictions = 0;
+
+  size_t num_of_models = 0;
+  size_t memory_usage = 0;
+};
+
+// Loads models saved with SaveModel on their first Get and caches them
+// without gradient buffers. Over the memory budget the least recently used
+// models are dropped from the cache (but not the one just loaded); a caller
+// still holding one keeps it alive. Concurrent Gets of the same model load it
+// only once.
+class ModelRegistry {
+ public:
+  explicit ModelRegistry(const ModelRegistryOptions& options = {},
+                         const ActivationFunctionsList& act_list = {},
+                         const LossFunctionsList& loss_list = {});
+
+  // lets Get find the model by name instead of file_path
+  void Register(const std::string& name, const std::string& file_path);
+
+  // Name given to Register or a file path, nullptr if the file can't be read
+  // or doesn't hold a model. Rethrows what loading throws (e.g.
+  // std::bad_alloc), to the Gets waiting for it as well, and doesn't cache it.
+  std::shared_ptr<const MultilayerPerceptron> Get(const std::string& name);
+
+  // drops the model from the cache, false if it isn't cached
+  bool Evict(const std::string& name);
+
+  ModelRegistryStats GetStats() const;
+
+ private:
+  using ModelPtr = std::shared_ptr<const MultilayerPerceptron>;
+
+  struct Entry {
+    std::shared_future<ModelPtr> model;
+
+    // position in _lru, which holds only the loaded models
+    std::list<std::string>::iterator lru_position;
+    bool loaded = false;
+    size_t memory_usage = 0;
+  };
+
+  ModelPtr Load(const std::string& file_path) const;
+
+  // drops the least recently used models except keep until the cache fits
+  void EvictOverBudget(const std::string& keep);
+
+  void Erase(std::unordered_map<std::string, Entry>::iterator it);
+
+  ModelRegistryOptions _options;
+  ActivationFunctionsList _act_list;
+  LossFunctionsList _loss_list;
+
+  mutable std::mutex _mutex;
+  std::unordered_map<std::string, std::string> _paths;
+  std::unordered_map<std::string, Entry> _entries;
+
+  // most recently used first
+  std::list<std::string> _lru;
+  ModelRegistryStats _stats;
+};
+
+}  // namespace mlp
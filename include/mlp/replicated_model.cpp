@@ -0,0 +1,61 @@
+#include "replicated_model.h"
+
+#include <algorithm>
+
+namespace mlp {
+
+ReplicatedModel::ReplicatedModel(const MultilayerPerceptron& model,
+                                 ThreadPool& pool)
+    : _pool(&pool) {
+  size_t num_of_replicas = 1;
+  if (pool.GetAffinity() != ThreadAffinity::kNone) {
+    num_of_replicas = std::min(NumaTopology::Get().GetNumOfNodes(),
+                               pool.GetNumOfThreads());
+  }
+
+  // worker n runs on node n, and the copy is first touched by it
+  _replicas.resize(num_of_replicas);
+  TaskGroup group(pool);
+  for (size_t node = 0; node < num_of_replicas; ++node) {
+    group.SubmitTo(node, [this, &model, node] {
+      _replicas[node] =
+          std::make_unique<MultilayerPerceptron>(model.CopyWithoutGradients());
+    });
+  }
+  group.Wait();
+}
+
+size_t ReplicatedModel::GetNumOfReplicas() const {
+  return _replicas.size();
+}
+
+const MultilayerPerceptron& ReplicatedModel::GetLocal() const {
+  size_t node = NumaTopology::Get().GetCurrentNode();
+  return *_replicas[node < _replicas.size() ? node : 0];
+}
+
+std::vector<Vector> ReplicatedModel::Calculate(
+    const std::vector<Vector>& inputs) const {
+  std::vector<Vector> outputs(inputs.size());
+
+  // only this call's tasks, other users of the pool keep running
+  TaskGroup group(*_pool);
+
+  size_t num_of_workers = _pool->GetNumOfThreads();
+  for (size_t w = 0; w < num_of_workers; ++w) {
+    size_t begin = inputs.size() * w / num_of_workers;
+    size_t end = inputs.size() * (w + 1) / num_of_workers;
+    const MultilayerPerceptron& model =
+        *_replicas[_pool->GetWorkerNode(w) % _replicas.size()];
+
+    group.SubmitTo(w, [&inputs, &outputs, &model, begin, end] {
+      for (size_t i = begin; i < end; ++i) {
+        outputs[i] = model.Calculate(inputs[i]);
+      }
+    });
+  }
+  group.Wait();
+  return outputs;
+}
+
+}  // namespace mlp
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "mlp.h"
+
+namespace mlp {
+
+// Read-only copies of a model for the NUMA nodes of a pinned ThreadPool, each
+// made by a worker of its node so its weights are in local memory. A pool
+// without affinity gets a single copy.
+class ReplicatedModel {
+ public:
+  ReplicatedModel(const MultilayerPerceptron& model, ThreadPool& pool);
+
+  size_t GetNumOfReplicas() const;
+
+  // copy of the node the calling thread runs on
+  const MultilayerPerceptron& GetLocal() const;
+
+  // The inputs split between the workers of the pool, every worker using the
+  // copy of its node. Waits only for its own tasks, so it may run
+  // concurrently with other users of the pool and from one of its workers.
+  std::vector<Vector> Calculate(const std::vector<Vector>& inputs) const;
+
+ private:
+  ThreadPool* _pool;
+
+  // by node
+  std::vector<std::unique_ptr<MultilayerPerceptron>> _replicas;
+};
+
+}  // namespace mlp
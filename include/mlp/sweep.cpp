@@ -0,0 +1,229 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <tuple>
+#include <utility>
+
+namespace mlp {
+
+namespace {
+
+// a diverged trial ranks like the worst possible one
+double RankLoss(double loss) {
+  return std::isnan(loss) ? std::numeric_limits<double>::infinity() : loss;
+}
+
+// unpruned trials first, then the lower loss, then the lower id
+std::tuple<bool, double, size_t> RankKey(const TrialResult& result) {
+  return {result.pruned, RankLoss(result.validation_loss), result.id};
+}
+
+}  // namespace
+
+MedianPruner::MedianPruner(bool enabled, size_t min_trials)
+    : _enabled(enabled), _min_trials(min_trials) {}
+
+bool MedianPruner::Report(size_t iteration, double loss) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  loss = RankLoss(loss);
+  if (_losses.size() <= iteration) {
+    _losses.resize(iteration + 1);
+  }
+  std::vector<double> others = _losses[iteration];
+  _losses[iteration].push_back(loss);
+
+  if (!_enabled || others.size() < _min_trials) {
+    return false;
+  }
+
+  auto middle = others.begin() + static_cast<ssize_t>(others.size() / 2);
+  std::nth_element(others.begin(), middle, others.end());
+  return loss > *middle;
+}
+
+SweepRunner::SweepRunner(std::shared_ptr<const DataSet> train_input,
+                         std::shared_ptr<const DataSet> train_output,
+                         std::shared_ptr<const DataSet> validation_input,
+                         std::shared_ptr<const DataSet> validation_output,
+                         const ActivationFunctionsList& act_list,
+                         const LossFunctionsList& loss_list)
+    : _train_input(std::move(train_input)),
+      _train_output(std::move(train_output)),
+      _validation_input(std::move(validation_input)),
+      _validation_output(std::move(validation_output)),
+      _act_list(act_list),
+      _loss_list(loss_list) {
+  assert(!_train_input->empty());
+  assert(_train_input->size() == _train_output->size());
+  assert(_validation_input->size() == _validation_output->size());
+}
+
+std::vector<TrialConfig> SweepRunner::MakeTrials(const SweepSpec& spec) const {
+  assert(!spec.hidden_layers.empty());
+  assert(!spec.activations.empty());
+  assert(!spec.batch_sizes.empty());
+
+  std::vector<TrialConfig> trials;
+
+  if (spec.search == SweepSpec::Search::kGrid) {
+    for (const auto& hidden : spec.hidden_layers) {
+      for (const auto& activation : spec.activations) {
+        for (size_t batch_size : spec.batch_sizes) {
+          trials.push_back({hidden, activation, batch_size});
+        }
+      }
+    }
+    return trials;
+  }
+
+  std::mt19937 gen(spec.seed);
+  auto pick = [&gen](size_t size) {
+    return std::uniform_int_distribution<size_t>(0, size - 1)(gen);
+  };
+  for (size_t i = 0; i < spec.num_of_trials; ++i) {
+    trials.push_back({spec.hidden_layers[pick(spec.hidden_layers.size())],
+                      spec.activations[pick(spec.activations.size())],
+                      spec.batch_sizes[pick(spec.batch_sizes.size())]});
+  }
+  return trials;
+}
+
+MultilayerPerceptron SweepRunner::MakeModel(const SweepSpec& spec,
+                                            const TrialConfig& config) const {
+  std::vector<ssize_t> dimensions;
+  std::vector<ActivationFunction> act_funcs;
+
+  dimensions.push_back(static_cast<ssize_t>(_train_input->front().size()));
+  for (ssize_t size : config.hidden_layers) {
+    dimensions.push_back(size);
+    act_funcs.push_back(_act_list.GetByName(config.activation));
+  }
+  dimensions.push_back(static_cast<ssize_t>(_train_output->front().size()));
+  act_funcs.push_back(_act_list.GetByName(spec.output_activation));
+
+  MultilayerPerceptron model(dimensions, act_funcs,
+                             _loss_list.GetByName(spec.loss));
+  model.SetBatchSize(config.batch_size);
+  return model;
+}
+
+void SweepRunner::Evaluate(const MultilayerPerceptron& model,
+                           const LossFunction& loss,
+                           TrialResult& result) const {
+  double total_loss = 0;
+  size_t correct_answers = 0;
+
+  for (size_t i = 0; i < _validation_input->size(); ++i) {
+    Vector r = model.Calculate(to_Vector((*_validation_input)[i]));
+    Vector y = to_Vector((*_validation_output)[i]);
+    total_loss += loss.CalculateLoss(r, y);
+
+    Eigen::Index chosen, expected;
+    r.maxCoeff(&chosen);
+    y.maxCoeff(&expected);
+    if (chosen == expected) {
+      ++correct_answers;
+    }
+  }
+
+  double size =
+      static_cast<double>(std::max<size_t>(1, _validation_input->size()));
+  result.validation_loss = total_loss / size;
+  result.accuracy = static_cast<double>(correct_answers) / size;
+}
+
+std::vector<TrialResult> SweepRunner::Run(const SweepSpec& spec) {
+  _best_model = MultilayerPerceptron();
+
+  std::vector<TrialConfig> trials = MakeTrials(spec);
+  LossFunction loss = _loss_list.GetByName(spec.loss);
+
+  // weights are initialized from std::rand, so models are created up front
+  // to keep a sweep reproducible
+  std::vector<MultilayerPerceptron> models;
+  models.reserve(trials.size());
+  for (const auto& config : trials) {
+    models.push_back(MakeModel(spec, config));
+  }
+
+  std::vector<TrialResult> results(trials.size());
+  MedianPruner pruner(spec.prune, spec.min_trials_to_prune);
+
+  // the trial ranked first by RankKey, the same order as the results
+  std::mutex best_mutex;
+  const TrialResult* best = nullptr;
+
+  ThreadPool pool(spec.num_of_threads, spec.affinity);
+  for (size_t id = 0; id < trials.size(); ++id) {
+    pool.Submit([&, id] {
+      auto start = std::chrono::steady_clock::now();
+      // a copy made by the worker has its weights on the worker's node
+      MultilayerPerceptron model = models[id];
+      models[id] = MultilayerPerceptron();
+      TrialResult& result = results[id];
+      result.id = id;
+      result.config = trials[id];
+
+      for (size_t it = 0; it < spec.num_of_iterations; ++it) {
+        model.Train(1, *_train_input, *_train_output);
+        Evaluate(model, loss, result);
+        result.num_of_iterations = it + 1;
+
+        if (pruner.Report(it, result.validation_loss)) {
+          result.pruned = true;
+          break;
+        }
+      }
+
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      result.seconds = elapsed.count();
+
+      {
+        std::lock_guard<std::mutex> lock(best_mutex);
+        if (best == nullptr || RankKey(result) < RankKey(*best)) {
+          best = &result;
+          _best_model = model;
+        }
+      }
+    });
+  }
+  pool.Wait();
+
+  std::sort(results.begin(), results.end(),
+            [](const TrialResult& lhs, const TrialResult& rhs) {
+              return RankKey(lhs) < RankKey(rhs);
+            });
+  return results;
+}
+
+const MultilayerPerceptron& SweepRunner::GetBestModel() const {
+  return _best_model;
+}
+
+void WriteSweepResults(std::ostream& out,
+                       const std::vector<TrialResult>& results) {
+  out << "id\thidden_layers\tactivation\tbatch_size\titerations\t"
+         "validation_loss\taccuracy\tpruned\tseconds\n";
+
+  for (const auto& result : results) {
+    std::string hidden;
+    for (ssize_t size : result.config.hidden_layers) {
+      hidden += (hidden.empty() ? "" : ",") + std::to_string(size);
+    }
+
+    out << result.id << '\t' << hidden << '\t' << result.config.activation
+        << '\t' << result.config.batch_size << '\t'
+        << result.num_of_iterations << '\t' << result.validation_loss << '\t'
+        << result.accuracy << '\t' << (result.pruned ? "yes" : "no") << '\t'
+        << result.seconds << '\n';
+  }
+}
+
+}  // namespace mlp
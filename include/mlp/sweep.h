@@ -0,0 +1,120 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "mlp.h"
+
+namespace mlp {
+
+struct SweepSpec {
+  enum class Search { kGrid, kRandom };
+
+  // candidate hidden layer sizes, for example {{16}, {32, 16}}
+  std::vector<std::vector<ssize_t>> hidden_layers;
+
+  // candidate activations of the hidden layers (ActivationFunctionsList names)
+  std::vector<std::string> activations;
+
+  std::vector<size_t> batch_sizes;
+
+  std::string output_activation = "softmax";
+  std::string loss = "square";
+  size_t num_of_iterations = 5;
+
+  Search search = Search::kGrid;
+
+  // random search only
+  size_t num_of_trials = 10;
+  unsigned seed = 0;
+
+  // 0 means one thread per hardware thread
+  size_t num_of_threads = 0;
+
+  // pinning of the trial threads, they spread over the NUMA nodes
+  ThreadAffinity affinity = ThreadAffinity::kNone;
+
+  // a trial is stopped once its validation loss after some epoch is worse
+  // than the median of the other trials that already reached that epoch
+  bool prune = true;
+  size_t min_trials_to_prune = 4;
+};
+
+struct TrialConfig {
+  std::vector<ssize_t> hidden_layers;
+  std::string activation;
+  size_t batch_size = 0;
+};
+
+struct TrialResult {
+  size_t id = 0;
+  TrialConfig config;
+  size_t num_of_iterations = 0;
+  double validation_loss = 0;
+  double accuracy = 0;
+  bool pruned = false;
+  double seconds = 0;
+};
+
+// Stops trials whose validation loss after some epoch is worse than the
+// median of the other trials that already reached that epoch. A NaN loss
+// counts as +inf. Thread safe.
+class MedianPruner {
+ public:
+  MedianPruner(bool enabled, size_t min_trials);
+
+  // records the loss and tells whether the trial should be stopped
+  bool Report(size_t iteration, double loss);
+
+ private:
+  bool _enabled;
+  size_t _min_trials;
+  std::mutex _mutex;
+  std::vector<std::vector<double>> _losses;
+};
+
+// Trains many models on the same data concurrently. The data sets are shared
+// read-only by every trial, so they are loaded only once per process.
+class SweepRunner {
+ public:
+  SweepRunner(std::shared_ptr<const DataSet> train_input,
+              std::shared_ptr<const DataSet> train_output,
+              std::shared_ptr<const DataSet> validation_input,
+              std::shared_ptr<const DataSet> validation_output,
+              const ActivationFunctionsList& act_list = {},
+              const LossFunctionsList& loss_list = {});
+
+  // Results are sorted best first: unpruned trials before pruned ones, then
+  // by validation loss (NaN, a diverged trial, last), then by id.
+  std::vector<TrialResult> Run(const SweepSpec& spec);
+
+  // model of results.front() of the last Run
+  const MultilayerPerceptron& GetBestModel() const;
+
+ private:
+  std::vector<TrialConfig> MakeTrials(const SweepSpec& spec) const;
+
+  MultilayerPerceptron MakeModel(const SweepSpec& spec,
+                                 const TrialConfig& config) const;
+
+  void Evaluate(const MultilayerPerceptron& model, const LossFunction& loss,
+                TrialResult& result) const;
+
+  std::shared_ptr<const DataSet> _train_input;
+  std::shared_ptr<const DataSet> _train_output;
+  std::shared_ptr<const DataSet> _validation_input;
+  std::shared_ptr<const DataSet> _validation_output;
+  ActivationFunctionsList _act_list;
+  LossFunctionsList _loss_list;
+
+  MultilayerPerceptron _best_model;
+};
+
+// tab separated table, one trial per line
+void WriteSweepResults(std::ostream& out,
+                       const std::vector<TrialResult>& results);
+
+}  // namespace mlp
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mlp {
+
+// Samples of raw integer features (e.g. uint8 pixels) stored contiguously,
+// num_of_features per sample. See MultilayerPerceptron::SetInputNormalization.
+template <typename T>
+struct FeatureBatch {
+  size_t num_of_features = 0;
+  std::vector<T> values;
+
+  size_t size() const {
+    return num_of_features == 0 ? 0 : values.size() / num_of_features;
+  }
+
+  const T* operator[](size_t i) const {
+    assert(i < size());
+    return values.data() + i * num_of_features;
+  }
+};
+
+}  // namespace mlp
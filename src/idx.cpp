@@ -0,0 +1,113 @@
+#include "idx.h"
+
+#include <fstream>
+
+namespace mlp {
+
+int32_t ReadIdxInt32(std::istream& in) {
+  uint8_t bytes[4] = {0, 0, 0, 0};
+  in.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+  // IDX stores integers in big endian
+  return static_cast<int32_t>((uint32_t(bytes[0]) << 24) |
+                              (uint32_t(bytes[1]) << 16) |
+                              (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]));
+}
+
+uint64_t GetBytesLeft(std::istream& in) {
+  std::streampos begin = in.tellg();
+  in.seekg(0, std::ios::end);
+  std::streampos end = in.tellg();
+  in.seekg(begin);
+  if (!in || end < begin) {
+    return 0;
+  }
+  return static_cast<uint64_t>(end - begin);
+}
+
+DataSet ReadIdxImages(const std::string& file_path) {
+  FeatureBatch<uint8_t> pixels = ReadIdxImagesRaw(file_path);
+
+  DataSet images(pixels.size());
+  for (size_t i = 0; i < images.size(); ++i) {
+    images[i].resize(pixels.num_of_features);
+    for (size_t j = 0; j < pixels.num_of_features; ++j) {
+      images[i][j] = static_cast<double>(pixels[i][j]) / 255.0;
+    }
+  }
+
+  return images;
+}
+
+FeatureBatch<uint8_t> ReadIdxImagesRaw(const std::string& file_path) {
+  std::ifstream in(file_path, std::ios::binary);
+  if (!in || ReadIdxInt32(in) != IDX_MAGIC_NUMBER_IMAGES) {
+    return {};
+  }
+
+  int32_t number_of_images = ReadIdxInt32(in);
+  int32_t number_of_rows = ReadIdxInt32(in);
+  int32_t number_of_columns = ReadIdxInt32(in);
+  if (!in || number_of_images < 0 || number_of_rows < 0 ||
+      number_of_columns < 0) {
+    return {};
+  }
+
+  // a corrupt header mustn't allocate more than the file holds, the
+  // division also keeps the product from overflowing
+  uint64_t num_of_features = static_cast<uint64_t>(number_of_rows) *
+                             static_cast<uint64_t>(number_of_columns);
+  uint64_t bytes_left = GetBytesLeft(in);
+  if (number_of_images > 0 &&
+      (num_of_features == 0 ||
+       static_cast<uint64_t>(number_of_images) >
+           bytes_left / num_of_features)) {
+    return {};
+  }
+
+  FeatureBatch<uint8_t> images;
+  images.num_of_features = static_cast<size_t>(num_of_features);
+  images.values.resize(static_cast<size_t>(number_of_images) *
+                       images.num_of_features);
+  in.read(reinterpret_cast<char*>(images.values.data()),
+          static_cast<std::streamsize>(images.values.size()));
+  if (!in) {
+    return {};
+  }
+
+  return images;
+}
+
+std::vector<uint8_t> ReadIdxLabels(const std::string& file_path) {
+  std::ifstream in(file_path, std::ios::binary);
+  if (!in || ReadIdxInt32(in) != IDX_MAGIC_NUMBER_LABELS) {
+    return {};
+  }
+
+  int32_t number_of_items = ReadIdxInt32(in);
+  if (!in || number_of_items < 0 ||
+      static_cast<uint64_t>(number_of_items) > GetBytesLeft(in)) {
+    return {};
+  }
+
+  std::vector<uint8_t> labels(static_cast<size_t>(number_of_items));
+  in.read(reinterpret_cast<char*>(labels.data()),
+          static_cast<std::streamsize>(labels.size()));
+  if (!in) {
+    return {};
+  }
+
+  return labels;
+}
+
+DataSet LabelsToDataSet(const std::vector<uint8_t>& labels,
+                        size_t num_of_classes) {
+  DataSet data_set(labels.size(), std::vector<double>(num_of_classes, 0.0));
+  for (size_t i = 0; i < labels.size(); ++i) {
+    if (labels[i] < num_of_classes) {
+      data_set[i][labels[i]] = 1.0;
+    }
+  }
+  return data_set;
+}
+
+}  // namespace mlp
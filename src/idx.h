@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "feature_batch.h"
+
+namespace mlp {
+
+using DataSet = std::vector<std::vector<double>>;
+
+enum { IDX_MAGIC_NUMBER_IMAGES = 2051, IDX_MAGIC_NUMBER_LABELS = 2049 };
+
+// a big endian integer of an IDX header, 0 past the end of in
+int32_t ReadIdxInt32(std::istream& in);
+
+// the bytes from the read position of in to its end, 0 on a failed stream
+uint64_t GetBytesLeft(std::istream& in);
+
+// Readers for the IDX format used by MNIST. Pixels are scaled to [0, 1].
+// An unreadable file or a wrong magic number gives an empty result.
+DataSet ReadIdxImages(const std::string& file_path);
+
+// the pixels as they are stored, one byte each
+FeatureBatch<uint8_t> ReadIdxImagesRaw(const std::string& file_path);
+
+std::vector<uint8_t> ReadIdxLabels(const std::string& file_path);
+
+// one-hot encoding of the labels
+DataSet LabelsToDataSet(const std::vector<uint8_t>& labels,
+                        size_t num_of_classes);
+
+}  // namespace mlp
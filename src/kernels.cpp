@@ -0,0 +1,356 @@
+#include "kernels.h"
+#include "kernels_exp.h"
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace mlp {
+
+namespace kernels {
+
+namespace generic {
+
+using ConstMatrixMap = Eigen::Map<const Eigen::MatrixXd>;
+using ConstVectorMap = Eigen::Map<const Eigen::VectorXd>;
+
+void Gemv(const double* A, ssize_t rows, ssize_t cols, const double* x,
+          const double* b, double* y) {
+  Eigen::Map<Eigen::VectorXd>(y, rows).noalias() =
+      ConstMatrixMap(A, rows, cols) * ConstVectorMap(x, cols) +
+      ConstVectorMap(b, rows);
+}
+
+void GemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                    const double* v, double* r) {
+  Eigen::Map<Eigen::VectorXd>(r, cols).noalias() =
+      ConstMatrixMap(A, rows, cols).transpose() * ConstVectorMap(v, rows);
+}
+
+void Rank1Update(double* A, ssize_t rows, ssize_t cols, const double* u,
+                 const double* z) {
+  Eigen::Map<Eigen::MatrixXd>(A, rows, cols).noalias() +=
+      ConstVectorMap(u, rows) * ConstVectorMap(z, cols).transpose();
+}
+
+void ExpApprox(const double* x, ssize_t n, double* y) {
+  for (ssize_t i = 0; i < n; ++i) {
+    double v = std::min(std::max(x[i], kExpMin), kExpMax);
+    double k = std::nearbyint(v * kLog2e);
+    double r = v - k * kLn2Hi - k * kLn2Lo;
+
+    double p = kExpCoefficients[kExpDegree];
+    for (int d = kExpDegree - 1; d >= 0; --d) {
+      p = p * r + kExpCoefficients[d];
+    }
+
+    // 2^k written straight into the exponent bits
+    int64_t bits = (static_cast<int64_t>(k) + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    y[i] = p * scale;
+  }
+}
+
+void SparseGemv(const double* A, ssize_t rows, ssize_t, const ssize_t* nz,
+                ssize_t num_of_nz, const double* x, const double* b,
+                double* y) {
+  Eigen::Map<Eigen::VectorXd> result(y, rows);
+  result = ConstVectorMap(b, rows);
+  for (ssize_t k = 0; k < num_of_nz; ++k) {
+    result.noalias() += ConstVectorMap(A + nz[k] * rows, rows) * x[nz[k]];
+  }
+}
+
+void SparseGemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                          const ssize_t* nz, ssize_t num_of_nz,
+                          const double* v, double* r) {
+  Eigen::Map<Eigen::VectorXd>(r, cols).setZero();
+  for (ssize_t k = 0; k < num_of_nz; ++k) {
+    r[nz[k]] = ConstVectorMap(A + nz[k] * rows, rows).dot(
+        ConstVectorMap(v, rows));
+  }
+}
+
+void SparseRank1Update(double* A, ssize_t rows, ssize_t, const ssize_t* nz,
+                       ssize_t num_of_nz, const double* u, const double* z) {
+  for (ssize_t k = 0; k < num_of_nz; ++k) {
+    Eigen::Map<Eigen::VectorXd>(A + nz[k] * rows, rows) +=
+        ConstVectorMap(u, rows) * z[nz[k]];
+  }
+}
+
+}  // namespace generic
+
+#if defined(MLP_X86_KERNELS)
+
+// defined in kernels_<isa>.cpp
+
+#define MLP_DECLARE_KERNELS(isa)                                             \
+  namespace isa {                                                            \
+  void Gemv(const double* A, ssize_t rows, ssize_t cols, const double* x,    \
+            const double* b, double* y);                                     \
+  void Rank1Update(double* A, ssize_t rows, ssize_t cols, const double* u,   \
+                   const double* z);                                         \
+  void ExpApprox(const double* x, ssize_t n, double* y);                     \
+  void SparseGemv(const double* A, ssize_t rows, ssize_t cols,               \
+                  const ssize_t* nz, ssize_t num_of_nz, const double* x,     \
+                  const double* b, double* y);                               \
+  void SparseRank1Update(double* A, ssize_t rows, ssize_t cols,              \
+                         const ssize_t* nz, ssize_t num_of_nz,               \
+                         const double* u, const double* z);                  \
+  }
+
+#define MLP_DECLARE_GEMV_TRANSPOSED(isa)                                     \
+  namespace isa {                                                            \
+  void GemvTransposed(const double* A, ssize_t rows, ssize_t cols,           \
+                      const double* v, double* r);                           \
+  void SparseGemvTransposed(const double* A, ssize_t rows, ssize_t cols,     \
+                            const ssize_t* nz, ssize_t num_of_nz,            \
+                            const double* v, double* r);                     \
+  }
+
+MLP_DECLARE_KERNELS(sse42)
+MLP_DECLARE_KERNELS(avx2)
+MLP_DECLARE_KERNELS(avx512)
+
+MLP_DECLARE_GEMV_TRANSPOSED(sse42)
+MLP_DECLARE_GEMV_TRANSPOSED(avx2)
+
+#undef MLP_DECLARE_GEMV_TRANSPOSED
+#undef MLP_DECLARE_KERNELS
+
+#endif
+
+namespace {
+
+const KernelTable generic_kernels = {
+    generic::Gemv,
+    generic::GemvTransposed,
+    generic::Rank1Update,
+    generic::ExpApprox,
+    generic::SparseGemv,
+    generic::SparseGemvTransposed,
+    generic::SparseRank1Update,
+};
+
+#if defined(MLP_X86_KERNELS)
+const KernelTable sse42_kernels = {
+    sse42::Gemv,
+    sse42::GemvTransposed,
+    sse42::Rank1Update,
+    sse42::ExpApprox,
+    sse42::SparseGemv,
+    sse42::SparseGemvTransposed,
+    sse42::SparseRank1Update,
+};
+const KernelTable avx2_kernels = {
+    avx2::Gemv,
+    avx2::GemvTransposed,
+    avx2::Rank1Update,
+    avx2::ExpApprox,
+    avx2::SparseGemv,
+    avx2::SparseGemvTransposed,
+    avx2::SparseRank1Update,
+};
+// AVX-512 hosts always have AVX2, whose dot products are faster on skinny
+// matrices
+const KernelTable avx512_kernels = {
+    avx512::Gemv,
+    avx2::GemvTransposed,
+    avx512::Rank1Update,
+    avx512::ExpApprox,
+    avx512::SparseGemv,
+    avx2::SparseGemvTransposed,
+    avx512::SparseRank1Update,
+};
+#endif
+
+std::atomic<const KernelTable*> active_kernels{nullptr};
+std::atomic<Isa> active_isa{Isa::kGeneric};
+
+// Where the sparse kernels break even with the dense ones in
+// mlp-kernels-benchmark depends on the kernel and the ISA, between 50% and 75%
+// density (at 75% most of them are slower). At 50% every kernel still wins.
+constexpr double kDefaultSparseDensity = 0.5;
+
+double DetectSparseDensity() {
+  const char* requested = std::getenv("MLP_SPARSE_DENSITY");
+  if (requested != nullptr) {
+    char* end = nullptr;
+    double density = std::strtod(requested, &end);
+    if (end != requested && density >= 0.0 && density <= 1.0) {
+      return density;
+    }
+  }
+  return kDefaultSparseDensity;
+}
+
+std::atomic<double> sparse_density{DetectSparseDensity()};
+
+Isa DetectIsa() {
+  const char* requested = std::getenv("MLP_KERNELS_ISA");
+  if (requested != nullptr) {
+    for (Isa isa : {Isa::kGeneric, Isa::kSse42, Isa::kAvx2, Isa::kAvx512}) {
+      if (GetIsaName(isa) == std::string(requested) && IsIsaSupported(isa)) {
+        return isa;
+      }
+    }
+  }
+
+  for (Isa isa : {Isa::kAvx512, Isa::kAvx2, Isa::kSse42}) {
+    if (IsIsaSupported(isa)) {
+      return isa;
+    }
+  }
+  return Isa::kGeneric;
+}
+
+const KernelTable& GetActiveKernels() {
+  const KernelTable* table = active_kernels.load(std::memory_order_acquire);
+  if (table == nullptr) {
+    SetActiveIsa(DetectIsa());
+    table = active_kernels.load(std::memory_order_acquire);
+  }
+  return *table;
+}
+
+}  // namespace
+
+bool IsIsaSupported(Isa isa) {
+  switch (isa) {
+    case Isa::kGeneric:
+      return true;
+#if defined(MLP_X86_KERNELS)
+    case Isa::kSse42:
+      return __builtin_cpu_supports("sse4.2");
+    case Isa::kAvx2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case Isa::kAvx512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+const char* GetIsaName(Isa isa) {
+  switch (isa) {
+    case Isa::kSse42:
+      return "sse4.2";
+    case Isa::kAvx2:
+      return "avx2";
+    case Isa::kAvx512:
+      return "avx512";
+    default:
+      return "generic";
+  }
+}
+
+const KernelTable& GetKernelTable(Isa isa) {
+  assert(IsIsaSupported(isa));
+
+  switch (isa) {
+#if defined(MLP_X86_KERNELS)
+    case Isa::kSse42:
+      return sse42_kernels;
+    case Isa::kAvx2:
+      return avx2_kernels;
+    case Isa::kAvx512:
+      return avx512_kernels;
+#endif
+    default:
+      return generic_kernels;
+  }
+}
+
+Isa GetActiveIsa() {
+  GetActiveKernels();
+  return active_isa.load();
+}
+
+void SetActiveIsa(Isa isa) {
+  if (!IsIsaSupported(isa)) {
+    isa = Isa::kGeneric;
+  }
+  active_isa.store(isa);
+  active_kernels.store(&GetKernelTable(isa), std::memory_order_release);
+}
+
+void Gemv(const double* A, ssize_t rows, ssize_t cols, const double* x,
+          const double* b, double* y) {
+  GetActiveKernels().gemv(A, rows, cols, x, b, y);
+}
+
+void GemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                    const double* v, double* r) {
+  GetActiveKernels().gemv_transposed(A, rows, cols, v, r);
+}
+
+void Rank1Update(double* A, ssize_t rows, ssize_t cols, const double* u,
+                 const double* z) {
+  GetActiveKernels().rank1_update(A, rows, cols, u, z);
+}
+
+void ExpApprox(const double* x, ssize_t n, double* y) {
+  GetActiveKernels().exp_approx(x, n, y);
+}
+
+void SparseGemv(const double* A, ssize_t rows, ssize_t cols,
+                const ssize_t* nz, ssize_t num_of_nz, const double* x,
+                const double* b, double* y) {
+  GetActiveKernels().sparse_gemv(A, rows, cols, nz, num_of_nz, x, b, y);
+}
+
+void SparseGemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                          const ssize_t* nz, ssize_t num_of_nz,
+                          const double* v, double* r) {
+  GetActiveKernels().sparse_gemv_transposed(A, rows, cols, nz, num_of_nz, v,
+                                            r);
+}
+
+void SparseRank1Update(double* A, ssize_t rows, ssize_t cols,
+                       const ssize_t* nz, ssize_t num_of_nz, const double* u,
+                       const double* z) {
+  GetActiveKernels().sparse_rank1_update(A, rows, cols, nz, num_of_nz, u, z);
+}
+
+double GetSparseDensity() {
+  return sparse_density.load(std::memory_order_relaxed);
+}
+
+void SetSparseDensity(double density) {
+  sparse_density.store(std::min(std::max(density, 0.0), 1.0),
+                       std::memory_order_relaxed);
+}
+
+ssize_t FindNonZeros(const double* x, ssize_t n, ssize_t* nz) {
+  double density = GetSparseDensity();
+  if (density <= 0.0) {
+    return -1;
+  }
+
+  ssize_t max_num_of_nz = static_cast<ssize_t>(density * n);
+  ssize_t num_of_nz = 0;
+  for (ssize_t j = 0; j < n; ++j) {
+    if (x[j] != 0.0) {
+      if (num_of_nz == max_num_of_nz) {
+        return -1;
+      }
+      nz[num_of_nz++] = j;
+    }
+  }
+  return num_of_nz;
+}
+
+}  // namespace kernels
+
+}  // namespace mlp
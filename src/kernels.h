@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdio.h>
+#include <sys/types.h>
+
+namespace mlp {
+
+namespace kernels {
+
+// Dense kernels of the linear layers and the approximate exp of the fast
+// activations. Matrices are column-major (Eigen's default), A has rows x cols
+// elements.
+//
+// Every kernel has an Eigen implementation and, on x86 builds, SSE4.2, AVX2
+// and AVX-512 ones. The best ISA supported by the host is chosen at runtime,
+// MLP_KERNELS_ISA=generic|sse4.2|avx2|avx512 in the environment overrides it.
+
+enum class Isa { kGeneric, kSse42, kAvx2, kAvx512 };
+
+// y = A * x + b
+using GemvFunction = void (*)(const double* A, ssize_t rows, ssize_t cols,
+                              const double* x, const double* b, double* y);
+
+// r = A^T * v
+using GemvTransposedFunction = void (*)(const double* A, ssize_t rows,
+                                        ssize_t cols, const double* v,
+                                        double* r);
+
+// A += u * z^T
+using Rank1UpdateFunction = void (*)(double* A, ssize_t rows, ssize_t cols,
+                                     const double* u, const double* z);
+
+// y = exp(x) approximately, see kernels_exp.h for the error bound
+using ExpApproxFunction = void (*)(const double* x, ssize_t n, double* y);
+
+// Sparse variants for the outputs of relu layers, which are mostly zeros:
+// only the columns nz[0, num_of_nz) of A (increasing) take part, x and z are
+// zero at the others.
+
+// y = A * x + b
+using SparseGemvFunction = void (*)(const double* A, ssize_t rows,
+                                    ssize_t cols, const ssize_t* nz,
+                                    ssize_t num_of_nz, const double* x,
+                                    const double* b, double* y);
+
+// r = A^T * v at the columns nz, zero at the others
+using SparseGemvTransposedFunction = void (*)(const double* A, ssize_t rows,
+                                              ssize_t cols, const ssize_t* nz,
+                                              ssize_t num_of_nz,
+                                              const double* v, double* r);
+
+// A += u * z^T
+using SparseRank1UpdateFunction = void (*)(double* A, ssize_t rows,
+                                           ssize_t cols, const ssize_t* nz,
+                                           ssize_t num_of_nz, const double* u,
+                                           const double* z);
+
+struct KernelTable {
+  GemvFunction gemv;
+  GemvTransposedFunction gemv_transposed;
+  Rank1UpdateFunction rank1_update;
+  ExpApproxFunction exp_approx;
+  SparseGemvFunction sparse_gemv;
+  SparseGemvTransposedFunction sparse_gemv_transposed;
+  SparseRank1UpdateFunction sparse_rank1_update;
+};
+
+bool IsIsaSupported(Isa isa);
+
+const char* GetIsaName(Isa isa);
+
+// kernels of the given ISA, it has to be supported by the host
+const KernelTable& GetKernelTable(Isa isa);
+
+Isa GetActiveIsa();
+
+void SetActiveIsa(Isa isa);
+
+void Gemv(const double* A, ssize_t rows, ssize_t cols, const double* x,
+          const double* b, double* y);
+
+void GemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                    const double* v, double* r);
+
+void Rank1Update(double* A, ssize_t rows, ssize_t cols, const double* u,
+                 const double* z);
+
+void ExpApprox(const double* x, ssize_t n, double* y);
+
+void SparseGemv(const double* A, ssize_t rows, ssize_t cols,
+                const ssize_t* nz, ssize_t num_of_nz, const double* x,
+                const double* b, double* y);
+
+void SparseGemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                          const ssize_t* nz, ssize_t num_of_nz,
+                          const double* v, double* r);
+
+void SparseRank1Update(double* A, ssize_t rows, ssize_t cols,
+                       const ssize_t* nz, ssize_t num_of_nz, const double* u,
+                       const double* z);
+
+// The layers measure the density of every input and take the sparse kernels
+// when at most this fraction of it is nonzero. MLP_SPARSE_DENSITY in the
+// environment overrides the default, 0 keeps every layer dense.
+double GetSparseDensity();
+
+void SetSparseDensity(double density);
+
+// Writes the indices of the nonzero x[j] to nz (room for n of them) and
+// returns their number, or -1 as soon as x is denser than GetSparseDensity().
+ssize_t FindNonZeros(const double* x, ssize_t n, ssize_t* nz);
+
+}  // namespace kernels
+
+}  // namespace mlp
@@ -0,0 +1,2 @@
+#define MLP_KERNELS_NAMESPACE avx2
+#include "kernels_simd.h"
@@ -0,0 +1,8 @@
+// GCC 12 AVX-512 intrinsics start from _mm512_undefined_pd() and trip
+// -Wmaybe-uninitialized once inlined (GCC bug 105593)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define MLP_KERNELS_NAMESPACE avx512
+#include "kernels_simd.h"
@@ -0,0 +1,29 @@
+#pragma once
+
+namespace mlp {
+
+namespace kernels {
+
+// Constants of ExpApprox, shared by the generic and the SIMD versions.
+//
+// exp(x) = 2^k * exp(r) with k = round(x / ln 2) and |r| <= ln(2) / 2, exp(r)
+// is a degree 6 Taylor polynomial. The relative error is below 2e-7 (the
+// truncation error r^7 / 7!), x is clamped to [-708, 709] so 2^k stays a
+// normal double.
+
+constexpr double kExpMin = -708.0;
+constexpr double kExpMax = 709.0;
+
+constexpr double kLog2e = 1.4426950408889634;
+
+// ln 2 split in two so k * kLn2Hi is exact
+constexpr double kLn2Hi = 6.93145751953125e-1;
+constexpr double kLn2Lo = 1.42860682030941723212e-6;
+
+constexpr int kExpDegree = 6;
+constexpr double kExpCoefficients[kExpDegree + 1] = {
+    1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720};
+
+}  // namespace kernels
+
+}  // namespace mlp
@@ -0,0 +1,441 @@
+// SIMD implementation of the kernels from kernels.h, included only by
+// kernels_<isa>.cpp. Every one of those files is compiled with its own -m
+// flags and defines MLP_KERNELS_NAMESPACE before including this header.
+//
+// Don't include headers with inline library code here: the linker is free to
+// keep an instance compiled for a newer ISA and call it on every host.
+
+#include <immintrin.h>
+#include <sys/types.h>
+
+#include "kernels_exp.h"
+
+#if !defined(MLP_KERNELS_NAMESPACE)
+#error "MLP_KERNELS_NAMESPACE has to be defined"
+#endif
+
+namespace mlp {
+
+namespace kernels {
+
+namespace MLP_KERNELS_NAMESPACE {
+
+namespace {
+
+#if defined(__AVX512F__)
+
+using Packet = __m512d;
+constexpr ssize_t kWidth = 8;
+
+inline Packet Load(const double* p) {
+  return _mm512_loadu_pd(p);
+}
+
+inline void Store(double* p, Packet v) {
+  _mm512_storeu_pd(p, v);
+}
+
+inline Packet Broadcast(double x) {
+  return _mm512_set1_pd(x);
+}
+
+inline Packet Add(Packet a, Packet b) {
+  return _mm512_add_pd(a, b);
+}
+
+// a * b + c
+inline Packet MulAdd(Packet a, Packet b, Packet c) {
+  return _mm512_fmadd_pd(a, b, c);
+}
+
+inline Packet Mul(Packet a, Packet b) {
+  return _mm512_mul_pd(a, b);
+}
+
+inline Packet Min(Packet a, Packet b) {
+  return _mm512_min_pd(a, b);
+}
+
+inline Packet Max(Packet a, Packet b) {
+  return _mm512_max_pd(a, b);
+}
+
+inline Packet Round(Packet v) {
+  return _mm512_roundscale_pd(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+// 2^k for an integral k in [-1022, 1023], written straight into the exponent
+inline Packet Pow2(Packet k) {
+  __m512i e = _mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(k));
+  e = _mm512_add_epi64(e, _mm512_set1_epi64(1023));
+  return _mm512_castsi512_pd(_mm512_slli_epi64(e, 52));
+}
+
+#elif defined(__AVX2__)
+
+using Packet = __m256d;
+constexpr ssize_t kWidth = 4;
+
+inline Packet Load(const double* p) {
+  return _mm256_loadu_pd(p);
+}
+
+inline void Store(double* p, Packet v) {
+  _mm256_storeu_pd(p, v);
+}
+
+inline Packet Broadcast(double x) {
+  return _mm256_set1_pd(x);
+}
+
+inline Packet Add(Packet a, Packet b) {
+  return _mm256_add_pd(a, b);
+}
+
+inline Packet MulAdd(Packet a, Packet b, Packet c) {
+#if defined(__FMA__)
+  return _mm256_fmadd_pd(a, b, c);
+#else
+  return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+}
+
+inline Packet Mul(Packet a, Packet b) {
+  return _mm256_mul_pd(a, b);
+}
+
+inline Packet Min(Packet a, Packet b) {
+  return _mm256_min_pd(a, b);
+}
+
+inline Packet Max(Packet a, Packet b) {
+  return _mm256_max_pd(a, b);
+}
+
+inline Packet Round(Packet v) {
+  return _mm256_round_pd(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+inline Packet Pow2(Packet k) {
+  __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+  e = _mm256_add_epi64(e, _mm256_set1_epi64x(1023));
+  return _mm256_castsi256_pd(_mm256_slli_epi64(e, 52));
+}
+
+inline double Sum(Packet v) {
+  __m128d low = _mm256_castpd256_pd128(v);
+  __m128d high = _mm256_extractf128_pd(v, 1);
+  low = _mm_add_pd(low, high);
+  return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+}
+
+inline void Sum4(const Packet* v, double* out) {
+  __m256d low = _mm256_hadd_pd(v[0], v[1]);
+  __m256d high = _mm256_hadd_pd(v[2], v[3]);
+  _mm256_storeu_pd(out, _mm256_add_pd(_mm256_permute2f128_pd(low, high, 0x20),
+                                      _mm256_permute2f128_pd(low, high, 0x31)));
+}
+
+#elif defined(__SSE4_2__)
+
+using Packet = __m128d;
+constexpr ssize_t kWidth = 2;
+
+inline Packet Load(const double* p) {
+  return _mm_loadu_pd(p);
+}
+
+inline void Store(double* p, Packet v) {
+  _mm_storeu_pd(p, v);
+}
+
+inline Packet Broadcast(double x) {
+  return _mm_set1_pd(x);
+}
+
+inline Packet Add(Packet a, Packet b) {
+  return _mm_add_pd(a, b);
+}
+
+inline Packet MulAdd(Packet a, Packet b, Packet c) {
+  return _mm_add_pd(_mm_mul_pd(a, b), c);
+}
+
+inline Packet Mul(Packet a, Packet b) {
+  return _mm_mul_pd(a, b);
+}
+
+inline Packet Min(Packet a, Packet b) {
+  return _mm_min_pd(a, b);
+}
+
+inline Packet Max(Packet a, Packet b) {
+  return _mm_max_pd(a, b);
+}
+
+inline Packet Round(Packet v) {
+  return _mm_round_pd(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+inline Packet Pow2(Packet k) {
+  __m128i e = _mm_cvtepi32_epi64(_mm_cvtpd_epi32(k));
+  e = _mm_add_epi64(e, _mm_set1_epi64x(1023));
+  return _mm_castsi128_pd(_mm_slli_epi64(e, 52));
+}
+
+inline double Sum(Packet v) {
+  return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+inline void Sum4(const Packet* v, double* out) {
+  _mm_storeu_pd(out, _mm_hadd_pd(v[0], v[1]));
+  _mm_storeu_pd(out + 2, _mm_hadd_pd(v[2], v[3]));
+}
+
+#else
+#error "kernels_simd.h needs SSE4.2, AVX2 or AVX-512"
+#endif
+
+// columns of A processed per pass of Gemv, keeps the slice of x in L1
+constexpr ssize_t kColumnBlock = 256;
+
+// The columns of A a kernel runs over: all of them or the nonzero ones of
+// the sparse kernels. Both compile to the same loops.
+struct AllColumns {
+  ssize_t operator[](ssize_t k) const { return k; }
+};
+
+struct ListedColumns {
+  const ssize_t* nz;
+
+  ssize_t operator[](ssize_t k) const { return nz[k]; }
+};
+
+// y[0, N * kWidth) += A[0, N * kWidth) x columns[k_begin, k_end) * x
+// two interleaved accumulator sets hide the latency of the multiply-adds
+template <int N, typename Columns>
+void GemvRowBlock(const double* A, ssize_t rows, Columns columns,
+                  ssize_t k_begin, ssize_t k_end, const double* x,
+                  double* y) {
+  Packet even[N];
+  Packet odd[N];
+  for (int k = 0; k < N; ++k) {
+    even[k] = Load(y + k * kWidth);
+    odd[k] = Broadcast(0.0);
+  }
+
+  ssize_t c = k_begin;
+  for (; c + 1 < k_end; c += 2) {
+    ssize_t j0 = columns[c];
+    ssize_t j1 = columns[c + 1];
+    const double* column0 = A + j0 * rows;
+    const double* column1 = A + j1 * rows;
+    Packet x0 = Broadcast(x[j0]);
+    Packet x1 = Broadcast(x[j1]);
+    for (int k = 0; k < N; ++k) {
+      even[k] = MulAdd(Load(column0 + k * kWidth), x0, even[k]);
+      odd[k] = MulAdd(Load(column1 + k * kWidth), x1, odd[k]);
+    }
+  }
+  if (c < k_end) {
+    ssize_t j = columns[c];
+    const double* column = A + j * rows;
+    Packet x0 = Broadcast(x[j]);
+    for (int k = 0; k < N; ++k) {
+      even[k] = MulAdd(Load(column + k * kWidth), x0, even[k]);
+    }
+  }
+
+  for (int k = 0; k < N; ++k) {
+    Store(y + k * kWidth, Add(even[k], odd[k]));
+  }
+}
+
+template <typename Columns>
+void GemvColumns(const double* A, ssize_t rows, Columns columns,
+                 ssize_t num_of_columns, const double* x, const double* b,
+                 double* y) {
+  for (ssize_t i = 0; i < rows; ++i) {
+    y[i] = b[i];
+  }
+
+  for (ssize_t k_begin = 0; k_begin < num_of_columns;
+       k_begin += kColumnBlock) {
+    ssize_t k_end = k_begin + kColumnBlock < num_of_columns
+                        ? k_begin + kColumnBlock
+                        : num_of_columns;
+
+    ssize_t i = 0;
+    for (; i + 4 * kWidth <= rows; i += 4 * kWidth) {
+      GemvRowBlock<4>(A + i, rows, columns, k_begin, k_end, x, y + i);
+    }
+    if (i + 2 * kWidth <= rows) {
+      GemvRowBlock<2>(A + i, rows, columns, k_begin, k_end, x, y + i);
+      i += 2 * kWidth;
+    }
+    if (i + kWidth <= rows) {
+      GemvRowBlock<1>(A + i, rows, columns, k_begin, k_end, x, y + i);
+      i += kWidth;
+    }
+    for (; i < rows; ++i) {
+      double sum = y[i];
+      for (ssize_t c = k_begin; c < k_end; ++c) {
+        sum += A[columns[c] * rows + i] * x[columns[c]];
+      }
+      y[i] = sum;
+    }
+  }
+}
+
+template <typename Columns>
+void Rank1UpdateColumns(double* A, ssize_t rows, Columns columns,
+                        ssize_t num_of_columns, const double* u,
+                        const double* z) {
+  for (ssize_t c = 0; c < num_of_columns; ++c) {
+    ssize_t j = columns[c];
+    double* column = A + j * rows;
+    Packet zj = Broadcast(z[j]);
+
+    ssize_t i = 0;
+    for (; i + kWidth <= rows; i += kWidth) {
+      Store(column + i, MulAdd(Load(u + i), zj, Load(column + i)));
+    }
+    for (; i < rows; ++i) {
+      column[i] += u[i] * z[j];
+    }
+  }
+}
+
+// see kernels_exp.h
+inline Packet ExpPacket(Packet x) {
+  x = Min(Max(x, Broadcast(kExpMin)), Broadcast(kExpMax));
+  Packet k = Round(Mul(x, Broadcast(kLog2e)));
+  Packet r = MulAdd(k, Broadcast(-kLn2Hi), x);
+  r = MulAdd(k, Broadcast(-kLn2Lo), r);
+
+  Packet p = Broadcast(kExpCoefficients[kExpDegree]);
+  for (int d = kExpDegree - 1; d >= 0; --d) {
+    p = MulAdd(p, r, Broadcast(kExpCoefficients[d]));
+  }
+  return Mul(p, Pow2(k));
+}
+
+#if !defined(__AVX512F__)
+
+// r[columns[c, c + N)] = A[:, columns[c, c + N)]^T * v
+template <int N, typename Columns>
+void DotColumns(const double* A, ssize_t rows, Columns columns, ssize_t c,
+                const double* v, double* r) {
+  const double* column[N];
+  Packet acc[N];
+  for (int k = 0; k < N; ++k) {
+    column[k] = A + columns[c + k] * rows;
+    acc[k] = Broadcast(0.0);
+  }
+
+  ssize_t i = 0;
+  for (; i + kWidth <= rows; i += kWidth) {
+    Packet vi = Load(v + i);
+    for (int k = 0; k < N; ++k) {
+      acc[k] = MulAdd(Load(column[k] + i), vi, acc[k]);
+    }
+  }
+
+  double sums[N];
+  if (N == 4) {
+    Sum4(acc, sums);
+  } else {
+    for (int k = 0; k < N; ++k) {
+      sums[k] = Sum(acc[k]);
+    }
+  }
+
+  for (int k = 0; k < N; ++k) {
+    for (ssize_t tail = i; tail < rows; ++tail) {
+      sums[k] += column[k][tail] * v[tail];
+    }
+    r[columns[c + k]] = sums[k];
+  }
+}
+
+template <typename Columns>
+void GemvTransposedColumns(const double* A, ssize_t rows, Columns columns,
+                           ssize_t num_of_columns, const double* v,
+                           double* r) {
+  ssize_t c = 0;
+  for (; c + 4 <= num_of_columns; c += 4) {
+    DotColumns<4>(A, rows, columns, c, v, r);
+  }
+  for (; c < num_of_columns; ++c) {
+    DotColumns<1>(A, rows, columns, c, v, r);
+  }
+}
+
+#endif
+
+}  // namespace
+
+void Gemv(const double* A, ssize_t rows, ssize_t cols, const double* x,
+          const double* b, double* y) {
+  GemvColumns(A, rows, AllColumns(), cols, x, b, y);
+}
+
+void SparseGemv(const double* A, ssize_t rows, ssize_t, const ssize_t* nz,
+                ssize_t num_of_nz, const double* x, const double* b,
+                double* y) {
+  GemvColumns(A, rows, ListedColumns{nz}, num_of_nz, x, b, y);
+}
+
+// 512-bit dot products lose to the 256-bit ones on skinny matrices, so the
+// AVX-512 kernel table uses the AVX2 versions (see mlp-kernels-benchmark)
+#if !defined(__AVX512F__)
+
+void GemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                    const double* v, double* r) {
+  GemvTransposedColumns(A, rows, AllColumns(), cols, v, r);
+}
+
+void SparseGemvTransposed(const double* A, ssize_t rows, ssize_t cols,
+                          const ssize_t* nz, ssize_t num_of_nz,
+                          const double* v, double* r) {
+  for (ssize_t j = 0; j < cols; ++j) {
+    r[j] = 0.0;
+  }
+  GemvTransposedColumns(A, rows, ListedColumns{nz}, num_of_nz, v, r);
+}
+
+#endif
+
+void Rank1Update(double* A, ssize_t rows, ssize_t cols, const double* u,
+                 const double* z) {
+  Rank1UpdateColumns(A, rows, AllColumns(), cols, u, z);
+}
+
+void SparseRank1Update(double* A, ssize_t rows, ssize_t, const ssize_t* nz,
+                       ssize_t num_of_nz, const double* u, const double* z) {
+  Rank1UpdateColumns(A, rows, ListedColumns{nz}, num_of_nz, u, z);
+}
+
+void ExpApprox(const double* x, ssize_t n, double* y) {
+  ssize_t i = 0;
+  for (; i + kWidth <= n; i += kWidth) {
+    Store(y + i, ExpPacket(Load(x + i)));
+  }
+
+  if (i < n) {
+    double tail[kWidth] = {};
+    for (ssize_t t = i; t < n; ++t) {
+      tail[t - i] = x[t];
+    }
+    Store(tail, ExpPacket(Load(tail)));
+    for (ssize_t t = i; t < n; ++t) {
+      y[t] = tail[t - i];
+    }
+  }
+}
+
+}  // namespace MLP_KERNELS_NAMESPACE
+
+}  // namespace kernels
+
+}  // namespace mlp
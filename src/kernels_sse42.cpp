@@ -0,0 +1,2 @@
+#define MLP_KERNELS_NAMESPACE sse42
+#include "kernels_simd.h"
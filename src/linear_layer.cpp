@@ -1,14 +1,87 @@
 #include "linear_layer.h"
+#include "idx.h"
+#include "kernels.h"
 
+#include <algorithm>
 #include <iostream>
+#include <utility>
 
 namespace mlp {
 
+namespace {
+
+// The indices of the nonzero x[j] when x is sparse enough for the sparse
+// kernels (see kernels::FindNonZeros), -1 otherwise. nz points into a buffer
+// of the thread, valid until the next call.
+ssize_t FindNonZeros(const Vector& x, const ssize_t*& nz) {
+  thread_local std::vector<ssize_t> buffer;
+  buffer.resize(static_cast<size_t>(x.size()));
+  nz = buffer.data();
+  return kernels::FindNonZeros(x.data(), x.size(), buffer.data());
+}
+
+}  // namespace
+
+size_t GetLayerBlockSize(ssize_t input_size, ssize_t output_size) {
+  return PadToCacheLine(static_cast<size_t>(input_size * output_size)) +
+         PadToCacheLine(static_cast<size_t>(output_size));
+}
+
 // begin -- Delta Linear Layer
 
-DeltaLinearLayer::DeltaLinearLayer(ssize_t input_size, ssize_t output_size) {
-  _dA = Matrix::Zero(output_size, input_size);
-  _db = Vector::Zero(output_size);
+DeltaLinearLayer::DeltaLinearLayer() : _dA(nullptr, 0, 0), _db(nullptr, 0) {}
+
+DeltaLinearLayer::DeltaLinearLayer(ssize_t input_size, ssize_t output_size)
+    : DeltaLinearLayer() {
+  _storage.assign(GetLayerBlockSize(input_size, output_size), 0.0);
+  Bind(input_size, output_size, _storage.data());
+}
+
+DeltaLinearLayer::DeltaLinearLayer(ssize_t input_size, ssize_t output_size,
+                                   double* data)
+    : DeltaLinearLayer() {
+  Bind(input_size, output_size, data);
+}
+
+DeltaLinearLayer::DeltaLinearLayer(const DeltaLinearLayer& other)
+    : DeltaLinearLayer() {
+  *this = other;
+}
+
+DeltaLinearLayer::DeltaLinearLayer(DeltaLinearLayer&& other)
+    : DeltaLinearLayer() {
+  *this = std::move(other);
+}
+
+DeltaLinearLayer& DeltaLinearLayer::operator=(const DeltaLinearLayer& other) {
+  if (this != &other) {
+    _storage = other._storage;
+    // a view shares the storage of other
+    double* data = _storage.empty() ? const_cast<double*>(other._dA.data())
+                                    : _storage.data();
+    Bind(other._dA.cols(), other._dA.rows(), data);
+  }
+  return *this;
+}
+
+DeltaLinearLayer& DeltaLinearLayer::operator=(DeltaLinearLayer&& other) {
+  if (this != &other) {
+    bool owning = !other._storage.empty();
+    double* data = const_cast<double*>(other._dA.data());
+    _storage = std::move(other._storage);
+    Bind(other._dA.cols(), other._dA.rows(), owning ? _storage.data() : data);
+    if (owning) {
+      other.Bind(0, 0, nullptr);
+    }
+  }
+  return *this;
+}
+
+void DeltaLinearLayer::Bind(ssize_t input_size, ssize_t output_size,
+                            double* data) {
+  size_t dA_size = PadToCacheLine(static_cast<size_t>(input_size * output_size));
+  new (&_dA) MatrixMap(data, output_size, input_size);
+  new (&_db) VectorMap(data == nullptr ? nullptr : data + dA_size, output_size);
 }
 
 void DeltaLinearLayer::Update_dA(const Vector& u, const Vector& z) {
@@ -18,7 +91,16 @@ void DeltaLinearLayer::Update_dA(const Vector& u, const Vector& z) {
   // u = \sigma'(Az + b) * u
   // dA = \sigma'(Az + b) * u * z
 
-  _dA += u * z.transpose();
+  // the columns of zero z[j] (e.g. inactive relu outputs) don't change
+  const ssize_t* nz = nullptr;
+  ssize_t num_of_nz = FindNonZeros(z, nz);
+  if (num_of_nz >= 0) {
+    kernels::SparseRank1Update(_dA.data(), _dA.rows(), _dA.cols(), nz,
+                               num_of_nz, u.data(), z.data());
+  } else {
+    kernels::Rank1Update(_dA.data(), _dA.rows(), _dA.cols(), u.data(),
+                         z.data());
+  }
 }
 
 void DeltaLinearLayer::Update_db(const Vector& u) {
@@ -26,11 +108,11 @@ void DeltaLinearLayer::Update_db(const Vector& u) {
   _db += u;
 }
 
-const Matrix& DeltaLinearLayer::Get_dA() const {
+const MatrixMap& DeltaLinearLayer::Get_dA() const {
   return _dA;
 }
 
-const Vector& DeltaLinearLayer::Get_db() const {
+const VectorMap& DeltaLinearLayer::Get_db() const {
   return _db;
 }
 
@@ -43,11 +125,72 @@ void DeltaLinearLayer::Clear() {
 
 // begin -- Linear Layer
 
-LinearLayer::LinearLayer(ssize_t input_size, ssize_t output_size) {
+LinearLayer::LinearLayer() : _A(nullptr, 0, 0), _b(nullptr, 0) {}
+
+LinearLayer::LinearLayer(ssize_t input_size, ssize_t output_size)
+    : LinearLayer() {
+  _storage.assign(GetLayerBlockSize(input_size, output_size), 0.0);
+  Bind(input_size, output_size, _storage.data());
+
   _A = Matrix::Random(output_size, input_size);
   _b = Vector::Random(output_size);
 }
 
+LinearLayer::LinearLayer(ssize_t input_size, ssize_t output_size,
+                         double* data)
+    : LinearLayer() {
+  Bind(input_size, output_size, data);
+}
+
+LinearLayer::LinearLayer(const Matrix& A, const Vector& b) : LinearLayer() {
+  assert(A.rows() == b.size());
+
+  _storage.assign(GetLayerBlockSize(A.cols(), A.rows()), 0.0);
+  Bind(A.cols(), A.rows(), _storage.data());
+
+  _A = A;
+  _b = b;
+}
+
+LinearLayer::LinearLayer(const LinearLayer& other) : LinearLayer() {
+  *this = other;
+}
+
+LinearLayer::LinearLayer(LinearLayer&& other) : LinearLayer() {
+  *this = std::move(other);
+}
+
+LinearLayer& LinearLayer::operator=(const LinearLayer& other) {
+  if (this != &other) {
+    _storage = other._storage;
+    // a view shares the storage of other
+    double* data = _storage.empty() ? const_cast<double*>(other._A.data())
+                                    : _storage.data();
+    Bind(other.GetInputSize(), other.GetOutputSize(), data);
+  }
+  return *this;
+}
+
+LinearLayer& LinearLayer::operator=(LinearLayer&& other) {
+  if (this != &other) {
+    bool owning = !other._storage.empty();
+    double* data = const_cast<double*>(other._A.data());
+    _storage = std::move(other._storage);
+    Bind(other.GetInputSize(), other.GetOutputSize(),
+         owning ? _storage.data() : data);
+    if (owning) {
+      other.Bind(0, 0, nullptr);
+    }
+  }
+  return *this;
+}
+
+void LinearLayer::Bind(ssize_t input_size, ssize_t output_size, double* data) {
+  size_t A_size = PadToCacheLine(static_cast<size_t>(input_size * output_size));
+  new (&_A) MatrixMap(data, output_size, input_size);
+  new (&_b) VectorMap(data == nullptr ? nullptr : data + A_size, output_size);
+}
+
 Vector LinearLayer::Calculate(const Vector& x) const {
   if (x.rows() != _A.cols()) {
     std::cout << x.rows() << " vs " << _A.cols() << std::endl;
@@ -56,7 +199,17 @@ Vector LinearLayer::Calculate(const Vector& x) const {
   assert(x.rows() == _A.cols());
   assert(_A.rows() == _b.rows());
 
-  return _A * x + _b;
+  Vector result(_A.rows());
+  const ssize_t* nz = nullptr;
+  ssize_t num_of_nz = FindNonZeros(x, nz);
+  if (num_of_nz >= 0) {
+    kernels::SparseGemv(_A.data(), _A.rows(), _A.cols(), nz, num_of_nz,
+                        x.data(), _b.data(), result.data());
+  } else {
+    kernels::Gemv(_A.data(), _A.rows(), _A.cols(), x.data(), _b.data(),
+                  result.data());
+  }
+  return result;
 }
 
 Vector LinearLayer::ThrowDerivative(const Matrix& dS, const Vector& u) const {
@@ -64,34 +217,55 @@ Vector LinearLayer::ThrowDerivative(const Matrix& dS, const Vector& u) const {
   assert(u.rows() == dS.rows());
   assert(u.rows() == dS.cols());
 
-  // u * dS(Ax + b) * A
-  Vector result = (u.transpose() * dS * _A).transpose();
+  // u * dS(Ax + b) * A = (A^T * (dS^T * u))^T
+  Vector v = dS.transpose() * u;
+  Vector result(_A.cols());
+  kernels::GemvTransposed(_A.data(), _A.rows(), _A.cols(), v.data(),
+                          result.data());
+
+  return result;
+}
+
+Vector LinearLayer::ThrowDerivative(const Matrix& dS, const Vector& u,
+                                    const Vector& mask) const {
+  assert(mask.rows() == _A.cols());
+
+  const ssize_t* nz = nullptr;
+  ssize_t num_of_nz = FindNonZeros(mask, nz);
+  if (num_of_nz < 0) {
+    return ThrowDerivative(dS, u);
+  }
+
+  Vector v = dS.transpose() * u;
+  Vector result(_A.cols());
+  kernels::SparseGemvTransposed(_A.data(), _A.rows(), _A.cols(), nz,
+                                num_of_nz, v.data(), result.data());
 
   return result;
 }
 
 void LinearLayer::UpdateParameters(const DeltaLinearLayer& delta,
                                    size_t batch_size) {
-  const Matrix& dA = delta.Get_dA();
-  const Vector& db = delta.Get_db();
+  const MatrixMap& dA = delta.Get_dA();
+  const VectorMap& db = delta.Get_db();
 
   _A -= dA / static_cast<double>(batch_size);
   _b -= db / static_cast<double>(batch_size);
 }
 
-Matrix& LinearLayer::GetARef() {
+MatrixMap& LinearLayer::GetARef() {
   return _A;
 }
 
-Vector& LinearLayer::GetbRef() {
+VectorMap& LinearLayer::GetbRef() {
   return _b;
 }
 
-const Matrix& LinearLayer::GetARef() const {
+const MatrixMap& LinearLayer::GetARef() const {
   return _A;
 }
 
-const Vector& LinearLayer::GetbRef() const {
+const VectorMap& LinearLayer::GetbRef() const {
   return _b;
 }
 
@@ -105,6 +279,153 @@ ssize_t LinearLayer::GetOutputSize() const {
 
 // end -- Linear Layer
 
+// begin -- Parameter Arena
+
+ParameterArena::ParameterArena(const std::vector<LinearLayer>& layers) {
+  _offsets.push_back(0);
+  for (const auto& layer : layers) {
+    _sizes.emplace_back(layer.GetInputSize(), layer.GetOutputSize());
+    _offsets.push_back(_offsets.back() +
+                       GetLayerBlockSize(_sizes.back().first,
+                                         _sizes.back().second));
+  }
+  _buffer.assign(_offsets.back(), 0.0);
+  Bind();
+
+  for (size_t i = 0; i < layers.size(); ++i) {
+    _layers[i].GetARef() = layers[i].GetARef();
+    _layers[i].GetbRef() = layers[i].GetbRef();
+  }
+}
+
+ParameterArena::ParameterArena(const ParameterArena& other)
+    : _buffer(other._buffer), _offsets(other._offsets), _sizes(other._sizes) {
+  Bind();
+}
+
+ParameterArena& ParameterArena::operator=(const ParameterArena& other) {
+  if (this != &other) {
+    _buffer = other._buffer;
+    _offsets = other._offsets;
+    _sizes = other._sizes;
+    Bind();
+  }
+  return *this;
+}
+
+void ParameterArena::Bind() {
+  _layers.clear();
+  for (size_t i = 0; i < _sizes.size(); ++i) {
+    _layers.emplace_back(_sizes[i].first, _sizes[i].second,
+                         _buffer.data() + _offsets[i]);
+  }
+}
+
+LinearLayer& ParameterArena::operator[](size_t i) {
+  return _layers[i];
+}
+
+const LinearLayer& ParameterArena::operator[](size_t i) const {
+  return _layers[i];
+}
+
+size_t ParameterArena::size() const {
+  return _layers.size();
+}
+
+const std::vector<size_t>& ParameterArena::GetOffsets() const {
+  return _offsets;
+}
+
+double* ParameterArena::GetData() {
+  return _buffer.data();
+}
+
+const double* ParameterArena::GetData() const {
+  return _buffer.data();
+}
+
+size_t ParameterArena::GetSize() const {
+  return _buffer.size();
+}
+
+// end -- Parameter Arena
+
+// begin -- Gradient Arena
+
+GradientArena::GradientArena(const ParameterArena& parameters,
+                             size_t first_layer)
+    : _offsets(parameters.GetOffsets()), _first_layer(first_layer) {
+  assert(first_layer <= parameters.size());
+
+  if (_offsets.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    _sizes.emplace_back(parameters[i].GetInputSize(),
+                        parameters[i].GetOutputSize());
+  }
+  _buffer.assign(_offsets.back() - _offsets[first_layer], 0.0);
+  Bind();
+}
+
+GradientArena::GradientArena(const GradientArena& other)
+    : _buffer(other._buffer),
+      _offsets(other._offsets),
+      _sizes(other._sizes),
+      _first_layer(other._first_layer) {
+  Bind();
+}
+
+GradientArena& GradientArena::operator=(const GradientArena& other) {
+  if (this != &other) {
+    _buffer = other._buffer;
+    _offsets = other._offsets;
+    _sizes = other._sizes;
+    _first_layer = other._first_layer;
+    Bind();
+  }
+  return *this;
+}
+
+void GradientArena::Bind() {
+  _layers.assign(_sizes.size(), DeltaLinearLayer());
+  for (size_t i = _first_layer; i < _sizes.size(); ++i) {
+    _layers[i] = DeltaLinearLayer(_sizes[i].first, _sizes[i].second,
+                                  _buffer.data() + _offsets[i] - GetOffset());
+  }
+}
+
+std::vector<DeltaLinearLayer>& GradientArena::GetLayers() {
+  return _layers;
+}
+
+size_t GradientArena::GetFirstLayer() const {
+  return _first_layer;
+}
+
+size_t GradientArena::GetOffset() const {
+  return _offsets.empty() ? 0 : _offsets[_first_layer];
+}
+
+double* GradientArena::GetData() {
+  return _buffer.data();
+}
+
+const double* GradientArena::GetData() const {
+  return _buffer.data();
+}
+
+size_t GradientArena::GetSize() const {
+  return _buffer.size();
+}
+
+void GradientArena::Clear() {
+  std::fill(_buffer.begin(), _buffer.end(), 0.0);
+}
+
+// end -- Gradient Arena
+
 // begin -- save and read functions
 
 template <typename T>
@@ -142,6 +463,16 @@ LinearLayer ReadLinearLayer(std::istream& in) {
   ReadFromStream(in, A_rows);
   ReadFromStream(in, A_cols);
 
+  // a corrupt size mustn't allocate more than the file holds
+  uint64_t doubles_left = GetBytesLeft(in) / sizeof(double);
+  if (!in || A_rows <= 0 || A_cols <= 0 ||
+      static_cast<uint64_t>(A_cols) >= doubles_left ||
+      static_cast<uint64_t>(A_rows) >
+          doubles_left / (static_cast<uint64_t>(A_cols) + 1)) {
+    in.setstate(std::ios::failbit);
+    return LinearLayer();
+  }
+
   LinearLayer layer(A_cols, A_rows);
   auto& A = layer.GetARef();
   auto& b = layer.GetbRef();
@@ -152,8 +483,11 @@ LinearLayer ReadLinearLayer(std::istream& in) {
     }
   }
 
-  ssize_t b_size;
+  ssize_t b_size = 0;
   ReadFromStream(in, b_size);
+  if (b_size != b.size()) {
+    in.setstate(std::ios::failbit);
+  }
 
   for (ssize_t i = 0; i < b.size(); ++i) {
     ReadFromStream(in, b[i]);
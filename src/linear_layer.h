@@ -1,3 +1,5 @@
+#pragma once
+
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <EigenRand/EigenRand>
@@ -7,63 +9,200 @@
 #include <cassert>
 #include <vector>
 
+#include "parameter_buffer.h"
+
 namespace mlp {
 
 using Matrix = Eigen::MatrixXd;
 using Vector = Eigen::VectorXd;
 
+// views into a ParameterBuffer, the blocks start on a cache line
+using MatrixMap = Eigen::Map<Matrix, Eigen::Aligned64>;
+using VectorMap = Eigen::Map<Vector, Eigen::Aligned64>;
+
+// Both layers either own their storage or are views into a buffer shared by
+// all layers of a model (see MultilayerPerceptron). A copy of an owning layer
+// is a deep copy, a copy of a view is a view of the same storage.
+
+// doubles a layer takes in a buffer: A and b, each padded to a cache line
+size_t GetLayerBlockSize(ssize_t input_size, ssize_t output_size);
+
 class DeltaLinearLayer {
  public:
-  DeltaLinearLayer() = default;
+  DeltaLinearLayer();
 
   DeltaLinearLayer(ssize_t input_size, ssize_t output_size);
 
+  // view of GetLayerBlockSize(input_size, output_size) doubles at data,
+  // which keep their values
+  DeltaLinearLayer(ssize_t input_size, ssize_t output_size, double* data);
+
+  DeltaLinearLayer(const DeltaLinearLayer& other);
+
+  DeltaLinearLayer(DeltaLinearLayer&& other);
+
+  DeltaLinearLayer& operator=(const DeltaLinearLayer& other);
+
+  DeltaLinearLayer& operator=(DeltaLinearLayer&& other);
+
   void Update_dA(const Vector& u, const Vector& z);
 
   void Update_db(const Vector& u);
 
-  const Matrix& Get_dA() const;
+  const MatrixMap& Get_dA() const;
 
-  const Vector& Get_db() const;
+  const VectorMap& Get_db() const;
 
   void Clear();
 
  private:
-  Matrix _dA;
-  Vector _db;
+  void Bind(ssize_t input_size, ssize_t output_size, double* data);
+
+  ParameterBuffer _storage;
+  MatrixMap _dA;
+  VectorMap _db;
 };
 
 class LinearLayer {
  public:
-  LinearLayer() = default;
+  LinearLayer();
 
+  // owns its parameters, initialized randomly
   LinearLayer(ssize_t input_size, ssize_t output_size);
 
+  // view of GetLayerBlockSize(input_size, output_size) doubles at data,
+  // which keep their values
+  LinearLayer(ssize_t input_size, ssize_t output_size, double* data);
+
+  // owns a copy of A and b
+  LinearLayer(const Matrix& A, const Vector& b);
+
+  LinearLayer(const LinearLayer& other);
+
+  LinearLayer(LinearLayer&& other);
+
+  LinearLayer& operator=(const LinearLayer& other);
+
+  LinearLayer& operator=(LinearLayer&& other);
+
   Vector Calculate(const Vector& x) const;
 
   Vector ThrowDerivative(const Matrix& dS, const Vector& u) const;
 
+  // Leaves the entries j with mask[j] == 0 zero, for a caller that multiplies
+  // them by a zero derivative anyway: mask is the input of this layer and the
+  // output of a relu layer (see NonLinearLayer::HasSparseGradient).
+  Vector ThrowDerivative(const Matrix& dS, const Vector& u,
+                         const Vector& mask) const;
+
   void UpdateParameters(const DeltaLinearLayer& delta, size_t batch_size);
 
-  Matrix& GetARef();
+  MatrixMap& GetARef();
 
-  Vector& GetbRef();
+  VectorMap& GetbRef();
 
-  const Matrix& GetARef() const;
+  const MatrixMap& GetARef() const;
 
-  const Vector& GetbRef() const;
+  const VectorMap& GetbRef() const;
 
   ssize_t GetInputSize() const;
 
   ssize_t GetOutputSize() const;
 
  private:
-  Matrix _A;
-  Vector _b;
+  void Bind(ssize_t input_size, ssize_t output_size, double* data);
+
+  ParameterBuffer _storage;
+  MatrixMap _A;
+  VectorMap _b;
+};
+
+// Parameters of consecutive linear layers in one ParameterBuffer, the layers
+// are views into it. Copies are deep.
+class ParameterArena {
+ public:
+  ParameterArena() = default;
+
+  // copies the values of the layers
+  explicit ParameterArena(const std::vector<LinearLayer>& layers);
+
+  ParameterArena(const ParameterArena& other);
+
+  ParameterArena(ParameterArena&& other) = default;
+
+  ParameterArena& operator=(const ParameterArena& other);
+
+  ParameterArena& operator=(ParameterArena&& other) = default;
+
+  LinearLayer& operator[](size_t i);
+
+  const LinearLayer& operator[](size_t i) const;
+
+  size_t size() const;
+
+  // offsets[i] is where layer i starts, offsets.back() is the buffer size
+  const std::vector<size_t>& GetOffsets() const;
+
+  double* GetData();
+
+  const double* GetData() const;
+
+  size_t GetSize() const;
+
+ private:
+  void Bind();
+
+  ParameterBuffer _buffer;
+  std::vector<size_t> _offsets;
+  std::vector<std::pair<ssize_t, ssize_t>> _sizes;
+  std::vector<LinearLayer> _layers;
+};
+
+// Gradients of the layers [first_layer, parameters.size()) in one buffer laid
+// out like the parameter buffer, so the optimizer step over all layers is a
+// single pass over two flat spans. Layers below first_layer get no gradients.
+class GradientArena {
+ public:
+  GradientArena() = default;
+
+  GradientArena(const ParameterArena& parameters, size_t first_layer);
+
+  GradientArena(const GradientArena& other);
+
+  GradientArena(GradientArena&& other) = default;
+
+  GradientArena& operator=(const GradientArena& other);
+
+  GradientArena& operator=(GradientArena&& other) = default;
+
+  std::vector<DeltaLinearLayer>& GetLayers();
+
+  size_t GetFirstLayer() const;
+
+  // position of GetData()[0] in the parameter buffer
+  size_t GetOffset() const;
+
+  double* GetData();
+
+  const double* GetData() const;
+
+  size_t GetSize() const;
+
+  void Clear();
+
+ private:
+  void Bind();
+
+  ParameterBuffer _buffer;
+  std::vector<size_t> _offsets;
+  std::vector<std::pair<ssize_t, ssize_t>> _sizes;
+  size_t _first_layer = 0;
+  std::vector<DeltaLinearLayer> _layers;
 };
 
 void WriteLinearLayer(std::ostream& out, const LinearLayer& layer);
 
+// fails in on sizes the rest of the file can't hold
 LinearLayer ReadLinearLayer(std::istream& in);
 
 }  // namespace mlp
@@ -39,13 +39,18 @@ LossFunction ReadLossFunction(std::istream& in, const LossFunctionsList& list) {
   ReadFromStream(in, name_size);
 
   std::string f_name;
-  for (size_t i = 0; i < name_size; ++i) {
+  for (size_t i = 0; i < name_size && in; ++i) {
     char c;
     ReadFromStream<char>(in, c);
     f_name += c;
   }
 
-  return list.GetByName(f_name);
+  auto f = list.GetByName(f_name);
+  if (f.GetName() != f_name) {
+    // GetByName falls back to the first function
+    in.setstate(std::ios::failbit);
+  }
+  return f;
 }
 
 }  // namespace mlp
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
@@ -88,6 +90,7 @@ class LossFunctionsList {
 
 void WriteLossFunction(std::ostream& out, const LossFunction& f);
 
+// fails in on a name missing from list
 LossFunction ReadLossFunction(std::istream& in, const LossFunctionsList& list);
 
 }  // namespace mlp
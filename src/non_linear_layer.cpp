@@ -1,4 +1,5 @@
 #include "non_linear_layer.h"
+#include "kernels.h"
 
 #include <cassert>
 
@@ -17,9 +18,12 @@ Vector sigmoid(const Vector& x) {
 }
 
 Matrix sigmoid_der(const Vector& x) {
-  Matrix result =
-      (exp(-x.array()) / pow(1.0 + exp(-x.array()), 2)).matrix().asDiagonal();
+  return sigmoid_der_from_output(x, sigmoid(x));
+}
 
+Matrix sigmoid_der_from_output(const Vector&, const Vector& y) {
+  // \sigma' = \sigma (1 - \sigma)
+  Matrix result = (y.array() * (1.0 - y.array())).matrix().asDiagonal();
   return result;
 }
 
@@ -34,15 +38,63 @@ Matrix relu_der(const Vector& x) {
 }
 
 Vector softmax(const Vector& x) {
-  double sum_exp = x.array().exp().sum();
-  Vector result = x.array().exp() / sum_exp;
+  // shifted by max(x) so exp can't overflow
+  Vector exps = (x.array() - x.maxCoeff()).exp();
+  Vector result = exps / exps.sum();
   return result;
 }
 
 Matrix softmax_der(const Vector& x) {
-  Vector computed = softmax(x);
-  Matrix diagonal = computed.asDiagonal();
-  Matrix result = diagonal - computed * computed.transpose();
+  return softmax_der_from_output(x, softmax(x));
+}
+
+Matrix softmax_der_from_output(const Vector&, const Vector& y) {
+  Matrix diagonal = y.asDiagonal();
+  Matrix result = diagonal - y * y.transpose();
+  return result;
+}
+
+Vector tanh(const Vector& x) {
+  Vector result = x.array().tanh();
+  return result;
+}
+
+Matrix tanh_der(const Vector& x) {
+  return tanh_der_from_output(x, tanh(x));
+}
+
+Matrix tanh_der_from_output(const Vector&, const Vector& y) {
+  Matrix result = (1.0 - y.array().square()).matrix().asDiagonal();
+  return result;
+}
+
+Vector identity(const Vector& x) {
+  return x;
+}
+
+Matrix identity_der(const Vector& x) {
+  return Matrix::Identity(x.size(), x.size());
+}
+
+Vector fast_sigmoid(const Vector& x) {
+  Vector result = -x;
+  kernels::ExpApprox(result.data(), result.size(), result.data());
+  result = 1.0 / (1.0 + result.array());
+  return result;
+}
+
+Vector fast_tanh(const Vector& x) {
+  // tanh(x) = 1 - 2 / (exp(2x) + 1)
+  Vector result = 2.0 * x;
+  kernels::ExpApprox(result.data(), result.size(), result.data());
+  result = 1.0 - 2.0 / (result.array() + 1.0);
+  return result;
+}
+
+Vector fast_softmax(const Vector& x) {
+  Vector result = x.array() - x.maxCoeff();
+  kernels::ExpApprox(result.data(), result.size(), result.data());
+  result /= result.sum();
   return result;
 }
 
@@ -74,13 +126,18 @@ ActivationFunction ReadActivationFunction(std::istream& in,
   ReadFromStream(in, name_size);
 
   std::string f_name;
-  for (size_t i = 0; i < name_size; ++i) {
+  for (size_t i = 0; i < name_size && in; ++i) {
     char c;
     ReadFromStream<char>(in, c);
     f_name += c;
   }
 
-  return list.GetByName(f_name);
+  auto f = list.GetByName(f_name);
+  if (f.GetName() != f_name) {
+    // GetByName falls back to the first function
+    in.setstate(std::ios::failbit);
+  }
+  return f;
 }
 
 // begin -- Non Linear Layer
@@ -95,6 +152,11 @@ Matrix NonLinearLayer::ThrowDerivative(const Vector& w) const {
   return _activation_func.ComputeDerivative(w);
 }
 
+Matrix NonLinearLayer::ThrowDerivative(const Vector& w, const Vector& z) const {
+  // \sigma'(Ax + b) where z = \sigma(Ax + b)
+  return _activation_func.ComputeDerivative(w, z);
+}
+
 // end -- Non Linear Layer
 
 }  // namespace mlp
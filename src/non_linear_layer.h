@@ -1,3 +1,5 @@
+#pragma once
+
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
@@ -16,67 +18,130 @@ using Vector = Eigen::VectorXd;
 
 namespace activation_functions {
 
+// *_der_from_output(x, y) take the already computed y = f(x) as well and
+// don't evaluate any exp
+
 Vector sigmoid(const Vector& x);
 Matrix sigmoid_der(const Vector& x);
+Matrix sigmoid_der_from_output(const Vector& x, const Vector& y);
 
 Vector relu(const Vector& x);
 Matrix relu_der(const Vector& x);
 
 Vector softmax(const Vector& x);
 Matrix softmax_der(const Vector& x);
+Matrix softmax_der_from_output(const Vector& x, const Vector& y);
+
+Vector tanh(const Vector& x);
+Matrix tanh_der(const Vector& x);
+Matrix tanh_der_from_output(const Vector& x, const Vector& y);
+
+// f(x) = x, e.g. between the two factors of a low-rank layer
+Vector identity(const Vector& x);
+Matrix identity_der(const Vector& x);
+
+// Approximations built on kernels::ExpApprox (relative error below 2e-7).
+// Max absolute error: 1e-7 for fast_sigmoid and fast_tanh, max relative
+// error: 1e-6 for fast_softmax. The derivatives are the *_der_from_output
+// ones of the exact functions.
+Vector fast_sigmoid(const Vector& x);
+Vector fast_tanh(const Vector& x);
+Vector fast_softmax(const Vector& x);
 
 }  // namespace activation_functions
 
 using AFunction = std::function<Vector(const Vector&)>;
 using ADerivative = std::function<Matrix(const Vector&)>;
+using AOutputDerivative = std::function<Matrix(const Vector&, const Vector&)>;
 
 class ActivationFunction {
  public:
   ActivationFunction()
       : _activation_function(activation_functions::sigmoid),
-        _derivative(activation_functions::sigmoid_der) {}
+        _derivative(activation_functions::sigmoid_der),
+        _output_derivative(activation_functions::sigmoid_der_from_output),
+        _function_name("sigmoid") {}
+
+  // sparse_gradient: see HasSparseGradient
+  ActivationFunction(const AFunction& func, const ADerivative& der,
+                     const std::string& name, bool sparse_gradient = false)
+      : _activation_function(func),
+        _derivative(der),
+        _function_name(name),
+        _sparse_gradient(sparse_gradient) {}
 
   ActivationFunction(const AFunction& func, const ADerivative& der,
-                     const std::string& name)
-      : _activation_function(func), _derivative(der), _function_name(name) {}
+                     const AOutputDerivative& output_der,
+                     const std::string& name, bool sparse_gradient = false)
+      : _activation_function(func),
+        _derivative(der),
+        _output_derivative(output_der),
+        _function_name(name),
+        _sparse_gradient(sparse_gradient) {}
 
   Vector Compute(const Vector& x) const { return _activation_function(x); }
 
   Matrix ComputeDerivative(const Vector& x) const { return _derivative(x); }
 
+  // y = Compute(x)
+  Matrix ComputeDerivative(const Vector& x, const Vector& y) const {
+    if (_output_derivative) {
+      return _output_derivative(x, y);
+    }
+    return _derivative(x);
+  }
+
   std::string GetName() const { return _function_name; }
 
+  // true when the derivative is zero wherever the output is zero (relu), so
+  // the gradient at those outputs is never needed
+  bool HasSparseGradient() const { return _sparse_gradient; }
+
  private:
   AFunction _activation_function;
   ADerivative _derivative;
+  AOutputDerivative _output_derivative;
   std::string _function_name;
+  bool _sparse_gradient = false;
 };
 
 class ActivationFunctionsList {
  public:
-  ActivationFunctionsList() {
-    _functions_list = {
-        {activation_functions::sigmoid, activation_functions::sigmoid_der,
-         "sigmoid"},
-        {activation_functions::relu, activation_functions::relu_der, "relu"},
-        {activation_functions::softmax, activation_functions::softmax_der,
-         "softmax"},
-    };
-  }
+  ActivationFunctionsList() { Clear(); }
 
   void Clear() {
+    using namespace activation_functions;
+
     _functions_list = {
-        {activation_functions::sigmoid, activation_functions::sigmoid_der,
-         "sigmoid"},
-        {activation_functions::relu, activation_functions::relu_der, "relu"},
-        {activation_functions::softmax, activation_functions::softmax_der,
-         "softmax"},
+        {sigmoid, sigmoid_der, sigmoid_der_from_output, "sigmoid"},
+        {relu, relu_der, "relu", true},
+        {softmax, softmax_der, softmax_der_from_output, "softmax"},
+        {tanh, tanh_der, tanh_der_from_output, "tanh"},
+        {identity, identity_der, "identity"},
+        {fast_sigmoid, sigmoid_der, sigmoid_der_from_output, "fast_sigmoid"},
+        {fast_tanh, tanh_der, tanh_der_from_output, "fast_tanh"},
+        {fast_softmax, softmax_der, softmax_der_from_output, "fast_softmax"},
     };
   }
 
   void InsertFunction(const AFunction& func, const ADerivative& der,
-                      const std::string& name) {
-    _functions_list.emplace_back(func, der, name);
+                      const std::string& name, bool sparse_gradient = false) {
+    _functions_list.emplace_back(func, der, name, sparse_gradient);
+  }
+
+  void InsertFunction(const AFunction& func, const ADerivative& der,
+                      const AOutputDerivative& output_der,
+                      const std::string& name, bool sparse_gradient = false) {
+    _functions_list.emplace_back(func, der, output_der, name, sparse_gradient);
+  }
+
+  bool Contains(const std::string& name) const {
+    for (const auto& f : _functions_list) {
+      if (f.GetName() == name) {
+        return true;
+      }
+    }
+    return false;
   }
 
   ActivationFunction GetByName(const std::string& name) const {
@@ -96,6 +161,7 @@ class ActivationFunctionsList {
 
 void WriteActivationFunction(std::ostream& out, const ActivationFunction& f);
 
+// fails in on a name missing from list
 ActivationFunction ReadActivationFunction(std::istream& in,
                                           const ActivationFunctionsList& list);
 
@@ -110,8 +176,16 @@ class NonLinearLayer {
 
   Matrix ThrowDerivative(const Vector& w) const;
 
+  // z = Calculate(w) from the forward pass
+  Matrix ThrowDerivative(const Vector& w, const Vector& z) const;
+
   ActivationFunction GetActivatioFunc() const { return _activation_func; }
 
+  // see ActivationFunction::HasSparseGradient
+  bool HasSparseGradient() const {
+    return _activation_func.HasSparseGradient();
+  }
+
  private:
   ActivationFunction _activation_func;
 };
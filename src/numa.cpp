@@ -0,0 +1,174 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace mlp {
+
+namespace {
+
+// CPUs the process may run on
+std::vector<int> GetAllowedCpus() {
+  std::vector<int> cpus;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    unsigned count = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < count; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+  }
+  return cpus;
+}
+
+std::vector<std::vector<int>> DetectNodes() {
+  std::vector<int> allowed = GetAllowedCpus();
+
+  std::vector<std::vector<int>> nodes;
+  // node numbers may have gaps, e.g. after CPU hot-unplug
+  for (int node = 0; node < 1024; ++node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/cpulist");
+    if (!in) {
+      continue;
+    }
+    std::string list;
+    std::getline(in, list);
+
+    std::vector<int> cpus;
+    for (int cpu : ParseCpuList(list)) {
+      if (std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+        cpus.push_back(cpu);
+      }
+    }
+    // memory-only nodes and nodes outside of the affinity mask
+    if (!cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+    }
+  }
+
+  if (nodes.empty()) {
+    nodes.push_back(allowed);
+  }
+  return nodes;
+}
+
+}  // namespace
+
+const NumaTopology& NumaTopology::Get() {
+  static const NumaTopology topology(DetectNodes());
+  return topology;
+}
+
+NumaTopology::NumaTopology(std::vector<std::vector<int>> node_cpus)
+    : _node_cpus(std::move(node_cpus)) {
+  assert(!_node_cpus.empty());
+
+  for (size_t node = 0; node < _node_cpus.size(); ++node) {
+    assert(!_node_cpus[node].empty());
+    for (int cpu : _node_cpus[node]) {
+      if (static_cast<size_t>(cpu) >= _cpu_nodes.size()) {
+        _cpu_nodes.resize(static_cast<size_t>(cpu) + 1, 0);
+      }
+      _cpu_nodes[static_cast<size_t>(cpu)] = node;
+    }
+  }
+}
+
+size_t NumaTopology::GetNumOfNodes() const {
+  return _node_cpus.size();
+}
+
+const std::vector<int>& NumaTopology::GetCpus(size_t node) const {
+  assert(node < _node_cpus.size());
+
+  return _node_cpus[node];
+}
+
+size_t NumaTopology::GetNode(int cpu) const {
+  if (cpu < 0 || static_cast<size_t>(cpu) >= _cpu_nodes.size()) {
+    return 0;
+  }
+  return _cpu_nodes[static_cast<size_t>(cpu)];
+}
+
+size_t NumaTopology::GetCurrentNode() const {
+#if defined(__linux__)
+  return GetNode(sched_getcpu());
+#else
+  return 0;
+#endif
+}
+
+std::vector<int> NumaTopology::GetWorkerCpus(size_t worker,
+                                             ThreadAffinity affinity) const {
+  const std::vector<int>& cpus = _node_cpus[GetWorkerNode(worker)];
+
+  switch (affinity) {
+    case ThreadAffinity::kCore:
+      // the workers of a node take its CPUs in turn
+      return {cpus[(worker / _node_cpus.size()) % cpus.size()]};
+    case ThreadAffinity::kNode:
+      return cpus;
+    default:
+      return {};
+  }
+}
+
+size_t NumaTopology::GetWorkerNode(size_t worker) const {
+  return worker % _node_cpus.size();
+}
+
+std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first
+                                         : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+bool PinCurrentThread(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return true;
+  }
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+}  // namespace mlp
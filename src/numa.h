@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mlp {
+
+// How ThreadPool workers are pinned. Workers go to the NUMA nodes round
+// robin, so any number of them spreads over all sockets.
+enum class ThreadAffinity {
+  // the OS schedules the workers
+  kNone,
+
+  // worker on one CPU of its node
+  kCore,
+
+  // worker on any CPU of its node
+  kNode,
+};
+
+// CPUs of every NUMA node usable by the process, read from
+// /sys/devices/system/node. Without the sysfs entries (or outside Linux) all
+// CPUs form one node.
+class NumaTopology {
+ public:
+  static const NumaTopology& Get();
+
+  explicit NumaTopology(std::vector<std::vector<int>> node_cpus);
+
+  size_t GetNumOfNodes() const;
+
+  const std::vector<int>& GetCpus(size_t node) const;
+
+  // node of the CPU, 0 for unknown ones
+  size_t GetNode(int cpu) const;
+
+  // node the calling thread runs on right now
+  size_t GetCurrentNode() const;
+
+  // CPUs worker may run on, empty for ThreadAffinity::kNone
+  std::vector<int> GetWorkerCpus(size_t worker, ThreadAffinity affinity) const;
+
+  size_t GetWorkerNode(size_t worker) const;
+
+ private:
+  std::vector<std::vector<int>> _node_cpus;
+  std::vector<size_t> _cpu_nodes;
+};
+
+// "0-3,8,10-11" as in the cpulist files of sysfs
+std::vector<int> ParseCpuList(const std::string& list);
+
+// false if the thread can't be pinned, cpus empty means no pinning
+bool PinCurrentThread(const std::vector<int>& cpus);
+
+}  // namespace mlp
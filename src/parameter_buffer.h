@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdio.h>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace mlp {
+
+constexpr size_t kCacheLineSize = 64;
+
+// allocates on cache line boundaries, so every block padded with
+// PadToCacheLine starts on its own cache line
+template <typename T>
+class CacheLineAllocator {
+ public:
+  using value_type = T;
+
+  CacheLineAllocator() = default;
+
+  template <typename U>
+  CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(
+        ::operator new(n * sizeof(T), std::align_val_t(kCacheLineSize)));
+  }
+
+  void deallocate(T* p, size_t) {
+    ::operator delete(p, std::align_val_t(kCacheLineSize));
+  }
+
+  template <typename U>
+  bool operator==(const CacheLineAllocator<U>&) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const CacheLineAllocator<U>&) const {
+    return false;
+  }
+};
+
+// Flat storage of the parameters (or the gradients) of several layers. The
+// layers keep Eigen::Map views into it, so the buffer must not be resized
+// while they are bound. Moving the vector keeps its data in place.
+using ParameterBuffer = std::vector<double, CacheLineAllocator<double>>;
+
+inline size_t PadToCacheLine(size_t num_of_doubles) {
+  const size_t line = kCacheLineSize / sizeof(double);
+  return (num_of_doubles + line - 1) / line * line;
+}
+
+}  // namespace mlp
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <Eigen/Core>
+
+namespace mlp {
+
+using Vector = Eigen::VectorXd;
+
+// Stream of training samples that doesn't have to fit in memory. Every epoch
+// starts with Reset and reads samples until Next returns false.
+class SampleSource {
+ public:
+  virtual ~SampleSource() = default;
+
+  virtual ssize_t GetInputSize() const = 0;
+
+  virtual ssize_t GetOutputSize() const = 0;
+
+  virtual size_t GetNumOfSamples() const = 0;
+
+  // starts a new epoch
+  virtual void Reset() = 0;
+
+  // false when the epoch is over
+  virtual bool Next(Vector& input, Vector& output) = 0;
+};
+
+}  // namespace mlp
@@ -0,0 +1,566 @@
+#include "sharded_dataset.h"
+#include "idx.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+
+namespace mlp {
+
+namespace {
+
+const char index_magic[4] = {'M', 'L', 'P', 'S'};
+const uint32_t index_version = 1;
+
+template <typename T>
+void WriteInStream(std::ostream& out, T x) {
+  out.write(reinterpret_cast<char*>(&x), sizeof(x));
+}
+
+template <typename T>
+void ReadFromStream(std::istream& in, T& x) {
+  in.read(reinterpret_cast<char*>(&x), sizeof(x));
+}
+
+std::string IndexPath(const std::string& directory) {
+  return directory + "/index";
+}
+
+std::string ShardPath(const std::string& directory, size_t shard) {
+  char name[32];
+  snprintf(name, sizeof(name), "/shard-%05zu", shard);
+  return directory + name;
+}
+
+size_t EncodedSize(FeatureEncoding encoding) {
+  switch (encoding) {
+    case FeatureEncoding::kFloat64:
+      return sizeof(double);
+    case FeatureEncoding::kFloat32:
+      return sizeof(float);
+    case FeatureEncoding::kFloat16:
+      return sizeof(uint16_t);
+    default:
+      return sizeof(uint8_t);
+  }
+}
+
+size_t EncodedOutputSize(OutputEncoding encoding, ssize_t output_size) {
+  if (encoding == OutputEncoding::kClassIndex) {
+    return sizeof(uint16_t);
+  }
+  return sizeof(float) * static_cast<size_t>(output_size);
+}
+
+// round to nearest even, out of range values become infinities
+uint16_t FloatToHalf(float value) {
+  uint32_t f;
+  std::memcpy(&f, &value, sizeof(f));
+  uint16_t sign = static_cast<uint16_t>((f >> 16) & 0x8000);
+  f &= 0x7fffffff;
+
+  if (f >= 0x47800000) {
+    // >= 2^16, infinity or NaN
+    return sign | (f > 0x7f800000 ? 0x7e00 : 0x7c00);
+  }
+  if (f < 0x38800000) {
+    // below 2^-14, subnormal half in units of 2^-24
+    float abs_value;
+    std::memcpy(&abs_value, &f, sizeof(abs_value));
+    return sign | static_cast<uint16_t>(std::nearbyint(abs_value * 16777216.0f));
+  }
+
+  // rebias the exponent from 127 to 15 and round the mantissa to 10 bits
+  f += 0xc8000fff + ((f >> 13) & 1);
+  return sign | static_cast<uint16_t>(f >> 13);
+}
+
+float HalfToFloat(uint16_t h) {
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+
+  if (exponent == 0) {
+    float result = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -result : result;
+  }
+
+  uint32_t bits = sign | (mantissa << 13);
+  bits |= exponent == 0x1f ? 0x7f800000 : (exponent + 112) << 23;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+// decoding through a table is much faster than HalfToFloat per feature
+const std::vector<float>& GetHalfToFloatTable() {
+  static const std::vector<float> table = [] {
+    std::vector<float> result(1 << 16);
+    for (size_t h = 0; h < result.size(); ++h) {
+      result[h] = HalfToFloat(static_cast<uint16_t>(h));
+    }
+    return result;
+  }();
+  return table;
+}
+
+}  // namespace
+
+// begin -- ShardedDataSetWriter
+
+ShardedDataSetWriter::ShardedDataSetWriter(const std::string& directory,
+                                           ssize_t input_size,
+                                           ssize_t output_size,
+                                           const ShardedDataSetOptions& options)
+    : _directory(directory),
+      _input_size(input_size),
+      _output_size(output_size),
+      _options(options) {
+  assert(input_size > 0 && output_size > 0);
+  assert(options.records_per_shard > 0 &&
+         options.records_per_shard <= UINT32_MAX);
+  assert(options.output_encoding != OutputEncoding::kClassIndex ||
+         output_size <= UINT16_MAX);
+
+  _record.resize(EncodedSize(options.input_encoding) *
+                     static_cast<size_t>(input_size) +
+                 EncodedOutputSize(options.output_encoding, output_size));
+
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  _ok = !error;
+}
+
+ShardedDataSetWriter::~ShardedDataSetWriter() {
+  if (!_finished) {
+    Finish();
+  }
+}
+
+bool ShardedDataSetWriter::IsOk() const {
+  return _ok;
+}
+
+bool ShardedDataSetWriter::OpenNextShard() {
+  _shard.close();
+  _shard.open(ShardPath(_directory, _shard_sizes.size()),
+              std::ios::binary | std::ios::trunc);
+  _shard_sizes.push_back(0);
+  return static_cast<bool>(_shard);
+}
+
+bool ShardedDataSetWriter::Add(const std::vector<double>& input,
+                               const std::vector<double>& output) {
+  assert(!_finished);
+  assert(input.size() == static_cast<size_t>(_input_size));
+  assert(output.size() == static_cast<size_t>(_output_size));
+
+  if (!_ok) {
+    return false;
+  }
+  if (_shard_sizes.empty() ||
+      _shard_sizes.back() == _options.records_per_shard) {
+    _ok = OpenNextShard();
+    if (!_ok) {
+      return false;
+    }
+  }
+
+  char* p = _record.data();
+  for (double x : input) {
+    switch (_options.input_encoding) {
+      case FeatureEncoding::kFloat64:
+        std::memcpy(p, &x, sizeof(x));
+        break;
+      case FeatureEncoding::kFloat32: {
+        float f = static_cast<float>(x);
+        std::memcpy(p, &f, sizeof(f));
+        break;
+      }
+      case FeatureEncoding::kFloat16: {
+        uint16_t h = FloatToHalf(static_cast<float>(x));
+        std::memcpy(p, &h, sizeof(h));
+        break;
+      }
+      case FeatureEncoding::kUInt8: {
+        double q = std::nearbyint((x - _options.input_offset) /
+                                  _options.input_scale);
+        *p = static_cast<char>(
+            static_cast<uint8_t>(std::min(255.0, std::max(0.0, q))));
+        break;
+      }
+    }
+    p += EncodedSize(_options.input_encoding);
+  }
+
+  if (_options.output_encoding == OutputEncoding::kClassIndex) {
+    uint16_t label = static_cast<uint16_t>(
+        std::max_element(output.begin(), output.end()) - output.begin());
+    std::memcpy(p, &label, sizeof(label));
+  } else {
+    for (double y : output) {
+      float f = static_cast<float>(y);
+      std::memcpy(p, &f, sizeof(f));
+      p += sizeof(f);
+    }
+  }
+
+  _shard.write(_record.data(), static_cast<std::streamsize>(_record.size()));
+  ++_shard_sizes.back();
+  _ok = static_cast<bool>(_shard);
+  return _ok;
+}
+
+bool ShardedDataSetWriter::Finish() {
+  _finished = true;
+  _shard.close();
+  if (!_ok) {
+    return false;
+  }
+
+  std::ofstream out(IndexPath(_directory), std::ios::binary | std::ios::trunc);
+
+  out.write(index_magic, sizeof(index_magic));
+  WriteInStream(out, index_version);
+  WriteInStream(out, static_cast<uint32_t>(_options.input_encoding));
+  WriteInStream(out, static_cast<uint32_t>(_options.output_encoding));
+  WriteInStream(out, static_cast<int64_t>(_input_size));
+  WriteInStream(out, static_cast<int64_t>(_output_size));
+  WriteInStream(out, _options.input_scale);
+  WriteInStream(out, _options.input_offset);
+  WriteInStream(out, static_cast<uint64_t>(_shard_sizes.size()));
+  for (uint64_t size : _shard_sizes) {
+    WriteInStream(out, size);
+  }
+
+  _ok = static_cast<bool>(out);
+  return _ok;
+}
+
+// end -- ShardedDataSetWriter
+
+bool WriteShardedDataSet(const std::string& directory, const DataSet& input,
+                         const DataSet& output,
+                         const ShardedDataSetOptions& options) {
+  assert(!input.empty());
+  assert(input.size() == output.size());
+
+  ShardedDataSetWriter writer(directory,
+                              static_cast<ssize_t>(input.front().size()),
+                              static_cast<ssize_t>(output.front().size()),
+                              options);
+  for (size_t i = 0; i < input.size(); ++i) {
+    if (!writer.Add(input[i], output[i])) {
+      return false;
+    }
+  }
+  return writer.Finish();
+}
+
+bool ConvertIdxToShardedDataSet(const std::string& images_path,
+                                const std::string& labels_path,
+                                size_t num_of_classes,
+                                const std::string& directory,
+                                const ShardedDataSetOptions& options) {
+  std::ifstream images(images_path, std::ios::binary);
+  std::ifstream labels(labels_path, std::ios::binary);
+  if (!images || ReadIdxInt32(images) != IDX_MAGIC_NUMBER_IMAGES ||
+      !labels || ReadIdxInt32(labels) != IDX_MAGIC_NUMBER_LABELS) {
+    return false;
+  }
+
+  int32_t number_of_images = ReadIdxInt32(images);
+  int32_t number_of_rows = ReadIdxInt32(images);
+  int32_t number_of_columns = ReadIdxInt32(images);
+  int32_t number_of_labels = ReadIdxInt32(labels);
+  if (!images || !labels || number_of_images <= 0 || number_of_rows <= 0 ||
+      number_of_columns <= 0 || number_of_images != number_of_labels) {
+    return false;
+  }
+
+  size_t size_of_image = static_cast<size_t>(number_of_rows) *
+                         static_cast<size_t>(number_of_columns);
+
+  ShardedDataSetWriter writer(directory, static_cast<ssize_t>(size_of_image),
+                              static_cast<ssize_t>(num_of_classes), options);
+
+  std::vector<uint8_t> pixels(size_of_image);
+  std::vector<double> input(size_of_image);
+  std::vector<double> output(num_of_classes);
+  for (int32_t i = 0; i < number_of_images; ++i) {
+    images.read(reinterpret_cast<char*>(pixels.data()),
+                static_cast<std::streamsize>(size_of_image));
+    uint8_t label = 0;
+    labels.read(reinterpret_cast<char*>(&label), sizeof(label));
+    if (!images || !labels || label >= num_of_classes) {
+      return false;
+    }
+
+    for (size_t j = 0; j < size_of_image; ++j) {
+      input[j] = static_cast<double>(pixels[j]) / 255.0;
+    }
+    std::fill(output.begin(), output.end(), 0.0);
+    output[label] = 1.0;
+
+    if (!writer.Add(input, output)) {
+      return false;
+    }
+  }
+  return writer.Finish();
+}
+
+// begin -- ShardedDataSetReader
+
+ShardedDataSetReader::ShardedDataSetReader(const std::string& directory,
+                                           const ShardedReadOptions& options)
+    : _directory(directory), _options(options), _gen(options.seed) {
+  assert(options.window_shards > 0);
+
+  std::ifstream in(IndexPath(directory), std::ios::binary);
+  char magic[4] = {0, 0, 0, 0};
+  in.read(magic, sizeof(magic));
+  uint32_t version = 0;
+  ReadFromStream(in, version);
+  if (!in || std::memcmp(magic, index_magic, sizeof(magic)) != 0 ||
+      version != index_version) {
+    return;
+  }
+
+  uint32_t input_encoding, output_encoding;
+  int64_t input_size, output_size;
+  uint64_t num_of_shards;
+  ReadFromStream(in, input_encoding);
+  ReadFromStream(in, output_encoding);
+  ReadFromStream(in, input_size);
+  ReadFromStream(in, output_size);
+  ReadFromStream(in, _input_scale);
+  ReadFromStream(in, _input_offset);
+  ReadFromStream(in, num_of_shards);
+  if (!in || input_encoding > 3 || output_encoding > 1 || input_size <= 0 ||
+      output_size <= 0) {
+    return;
+  }
+
+  // a corrupt count mustn't allocate more than the index holds
+  if (num_of_shards > GetBytesLeft(in) / sizeof(uint64_t)) {
+    return;
+  }
+
+  _shard_sizes.resize(num_of_shards);
+  for (auto& size : _shard_sizes) {
+    ReadFromStream(in, size);
+  }
+  if (!in) {
+    return;
+  }
+
+  _input_encoding = static_cast<FeatureEncoding>(input_encoding);
+  _output_encoding = static_cast<OutputEncoding>(output_encoding);
+  _input_size = static_cast<ssize_t>(input_size);
+  _output_size = static_cast<ssize_t>(output_size);
+  _record_size = EncodedSize(_input_encoding) * static_cast<size_t>(input_size) +
+                 EncodedOutputSize(_output_encoding, _output_size);
+  _num_of_samples = static_cast<size_t>(
+      std::accumulate(_shard_sizes.begin(), _shard_sizes.end(), uint64_t(0)));
+  _ok = true;
+
+  Reset();
+}
+
+ShardedDataSetReader::~ShardedDataSetReader() {
+  ReleaseWindow(_window);
+  ReleaseWindow(_read_ahead);
+}
+
+bool ShardedDataSetReader::IsOk() const {
+  return _ok;
+}
+
+ssize_t ShardedDataSetReader::GetInputSize() const {
+  return _input_size;
+}
+
+ssize_t ShardedDataSetReader::GetOutputSize() const {
+  return _output_size;
+}
+
+size_t ShardedDataSetReader::GetNumOfSamples() const {
+  return _num_of_samples;
+}
+
+size_t ShardedDataSetReader::GetNumOfShards() const {
+  return _shard_sizes.size();
+}
+
+ShardedDataSetReader::MappedShard ShardedDataSetReader::MapShard(
+    size_t shard) const {
+  MappedShard mapped;
+
+  int fd = open(ShardPath(_directory, shard).c_str(), O_RDONLY);
+  if (fd < 0) {
+    return mapped;
+  }
+
+  struct stat info;
+  size_t size = fstat(fd, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+  // a truncated shard gives only its complete records
+  uint64_t num_of_records =
+      std::min<uint64_t>(_shard_sizes[shard], size / _record_size);
+
+  if (num_of_records > 0) {
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      // start reading the whole shard in the background
+      madvise(data, size, MADV_WILLNEED);
+      mapped.data = static_cast<const char*>(data);
+      mapped.size = size;
+      mapped.num_of_records = num_of_records;
+    }
+  }
+
+  close(fd);
+  return mapped;
+}
+
+void ShardedDataSetReader::UnmapShard(MappedShard& shard) const {
+  if (shard.data != nullptr) {
+    munmap(const_cast<char*>(shard.data), shard.size);
+  }
+  shard = MappedShard();
+}
+
+void ShardedDataSetReader::ReleaseWindow(
+    std::vector<MappedShard>& window) const {
+  for (auto& shard : window) {
+    UnmapShard(shard);
+  }
+  window.clear();
+}
+
+void ShardedDataSetReader::Reset() {
+  ReleaseWindow(_window);
+  ReleaseWindow(_read_ahead);
+  _records.clear();
+  _position = 0;
+  _next_window = 0;
+
+  _shard_order.resize(_shard_sizes.size());
+  std::iota(_shard_order.begin(), _shard_order.end(), 0);
+  if (_options.shuffle) {
+    std::shuffle(_shard_order.begin(), _shard_order.end(), _gen);
+  }
+}
+
+void ShardedDataSetReader::LoadWindow(size_t first) {
+  ReleaseWindow(_window);
+
+  size_t last = std::min(first + _options.window_shards, _shard_order.size());
+  if (!_read_ahead.empty()) {
+    _window.swap(_read_ahead);
+  } else {
+    for (size_t s = first; s < last; ++s) {
+      _window.push_back(MapShard(_shard_order[s]));
+    }
+  }
+  _next_window = last;
+
+  size_t ahead_last =
+      std::min(last + _options.window_shards, _shard_order.size());
+  for (size_t s = last; s < ahead_last; ++s) {
+    _read_ahead.push_back(MapShard(_shard_order[s]));
+  }
+
+  _records.clear();
+  _position = 0;
+  for (size_t w = 0; w < _window.size(); ++w) {
+    for (uint64_t r = 0; r < _window[w].num_of_records; ++r) {
+      _records.emplace_back(static_cast<uint32_t>(w), static_cast<uint32_t>(r));
+    }
+  }
+  if (_options.shuffle) {
+    std::shuffle(_records.begin(), _records.end(), _gen);
+  }
+}
+
+bool ShardedDataSetReader::Next(Vector& input, Vector& output) {
+  if (!_ok) {
+    return false;
+  }
+
+  while (_position == _records.size()) {
+    if (_next_window == _shard_order.size()) {
+      return false;
+    }
+    LoadWindow(_next_window);
+  }
+
+  const auto& record = _records[_position++];
+  DecodeRecord(_window[record.first].data + record.second * _record_size,
+               input, output);
+  return true;
+}
+
+void ShardedDataSetReader::DecodeRecord(const char* record, Vector& input,
+                                        Vector& output) const {
+  input.resize(_input_size);
+  output.resize(_output_size);
+
+  switch (_input_encoding) {
+    case FeatureEncoding::kFloat64:
+      std::memcpy(input.data(), record,
+                  sizeof(double) * static_cast<size_t>(_input_size));
+      break;
+    case FeatureEncoding::kFloat32:
+      for (ssize_t j = 0; j < _input_size; ++j) {
+        float f;
+        std::memcpy(&f, record + j * sizeof(f), sizeof(f));
+        input[j] = f;
+      }
+      break;
+    case FeatureEncoding::kFloat16: {
+      const float* table = GetHalfToFloatTable().data();
+      for (ssize_t j = 0; j < _input_size; ++j) {
+        uint16_t h;
+        std::memcpy(&h, record + j * sizeof(h), sizeof(h));
+        input[j] = table[h];
+      }
+      break;
+    }
+    case FeatureEncoding::kUInt8: {
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(record);
+      for (ssize_t j = 0; j < _input_size; ++j) {
+        input[j] = bytes[j] * _input_scale + _input_offset;
+      }
+      break;
+    }
+  }
+
+  const char* p =
+      record + EncodedSize(_input_encoding) * static_cast<size_t>(_input_size);
+  if (_output_encoding == OutputEncoding::kClassIndex) {
+    uint16_t label;
+    std::memcpy(&label, p, sizeof(label));
+    output.setZero();
+    if (label < _output_size) {
+      output[label] = 1.0;
+    }
+  } else {
+    for (ssize_t j = 0; j < _output_size; ++j) {
+      float f;
+      std::memcpy(&f, p + j * sizeof(f), sizeof(f));
+      output[j] = f;
+    }
+  }
+}
+
+// end -- ShardedDataSetReader
+
+}  // namespace mlp
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <stdio.h>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sample_source.h"
+
+namespace mlp {
+
+using DataSet = std::vector<std::vector<double>>;
+
+// On-disk sharded data set for training on more data than fits in memory.
+//
+// A data set is a directory with an "index" file and shard files
+// "shard-00000", "shard-00001", ... Each shard is a plain array of fixed-width
+// records: the encoded input features followed by the encoded output. The
+// index stores the encodings, the sizes and the number of records per shard.
+// Integers and floats are stored in the host byte order.
+
+enum class FeatureEncoding : uint32_t {
+  kFloat64 = 0,
+  kFloat32 = 1,
+  // IEEE 754 half precision, about 3 significant digits
+  kFloat16 = 2,
+  // value = byte * scale + offset
+  kUInt8 = 3,
+};
+
+enum class OutputEncoding : uint32_t {
+  kFloat32 = 0,
+  // uint16 index of the 1.0 in a one-hot output of output_size classes
+  kClassIndex = 1,
+};
+
+struct ShardedDataSetOptions {
+  FeatureEncoding input_encoding = FeatureEncoding::kFloat32;
+  OutputEncoding output_encoding = OutputEncoding::kFloat32;
+
+  // used only by kUInt8
+  double input_scale = 1.0 / 255.0;
+  double input_offset = 0.0;
+
+  size_t records_per_shard = 1 << 16;
+};
+
+// Writes samples one by one, so the converters never hold the whole data set.
+class ShardedDataSetWriter {
+ public:
+  ShardedDataSetWriter(const std::string& directory, ssize_t input_size,
+                       ssize_t output_size,
+                       const ShardedDataSetOptions& options = {});
+
+  ~ShardedDataSetWriter();
+
+  // false if the directory can't be written
+  bool IsOk() const;
+
+  bool Add(const std::vector<double>& input, const std::vector<double>& output);
+
+  // writes the index, returns false if anything failed
+  bool Finish();
+
+ private:
+  bool OpenNextShard();
+
+  std::string _directory;
+  ssize_t _input_size;
+  ssize_t _output_size;
+  ShardedDataSetOptions _options;
+
+  std::ofstream _shard;
+  std::vector<uint64_t> _shard_sizes;
+  std::vector<char> _record;
+  bool _ok = true;
+  bool _finished = false;
+};
+
+bool WriteShardedDataSet(const std::string& directory, const DataSet& input,
+                         const DataSet& output,
+                         const ShardedDataSetOptions& options = {});
+
+// Streams IDX images and labels into a data set with one-hot outputs. For
+// kUInt8 with the default scale the pixels are stored as they are.
+bool ConvertIdxToShardedDataSet(const std::string& images_path,
+                                const std::string& labels_path,
+                                size_t num_of_classes,
+                                const std::string& directory,
+                                const ShardedDataSetOptions& options = {});
+
+struct ShardedReadOptions {
+  // shuffle the order of the shards and the records of the shard window
+  bool shuffle = true;
+
+  // shards mapped at once, records are shuffled across all of them; the
+  // resident memory is about 2 * window_shards shards (the next window is
+  // read ahead)
+  size_t window_shards = 2;
+
+  unsigned seed = 0;
+};
+
+// Reads a sharded data set with mmap. Mapped shards are released as soon as
+// their window is consumed, so the resident memory doesn't depend on the
+// size of the data set.
+class ShardedDataSetReader : public SampleSource {
+ public:
+  ShardedDataSetReader(const std::string& directory,
+                       const ShardedReadOptions& options = {});
+
+  ~ShardedDataSetReader() override;
+
+  ShardedDataSetReader(const ShardedDataSetReader&) = delete;
+  ShardedDataSetReader& operator=(const ShardedDataSetReader&) = delete;
+
+  // false if the index can't be read
+  bool IsOk() const;
+
+  ssize_t GetInputSize() const override;
+
+  ssize_t GetOutputSize() const override;
+
+  size_t GetNumOfSamples() const override;
+
+  size_t GetNumOfShards() const;
+
+  void Reset() override;
+
+  bool Next(Vector& input, Vector& output) override;
+
+ private:
+  struct MappedShard {
+    const char* data = nullptr;
+    size_t size = 0;
+    uint64_t num_of_records = 0;
+  };
+
+  MappedShard MapShard(size_t shard) const;
+
+  void UnmapShard(MappedShard& shard) const;
+
+  // maps the window starting at _shard_order[first] and reads ahead the next
+  void LoadWindow(size_t first);
+
+  void ReleaseWindow(std::vector<MappedShard>& window) const;
+
+  void DecodeRecord(const char* record, Vector& input, Vector& output) const;
+
+  std::string _directory;
+  ShardedReadOptions _options;
+  bool _ok = false;
+
+  FeatureEncoding _input_encoding = FeatureEncoding::kFloat32;
+  OutputEncoding _output_encoding = OutputEncoding::kFloat32;
+  double _input_scale = 1.0;
+  double _input_offset = 0.0;
+  ssize_t _input_size = 0;
+  ssize_t _output_size = 0;
+  size_t _record_size = 0;
+  std::vector<uint64_t> _shard_sizes;
+  size_t _num_of_samples = 0;
+
+  std::mt19937 _gen;
+  std::vector<size_t> _shard_order;
+  size_t _next_window = 0;
+
+  std::vector<MappedShard> _window;
+  std::vector<MappedShard> _read_ahead;
+  // (shard in the window, record) pairs in the reading order
+  std::vector<std::pair<uint32_t, uint32_t>> _records;
+  size_t _position = 0;
+};
+
+}  // namespace mlp
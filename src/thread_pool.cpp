@@ -0,0 +1,267 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <utility>
+
+namespace mlp {
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t num_of_threads, ThreadAffinity affinity)
+    : _affinity(affinity) {
+  if (num_of_threads == 0) {
+    num_of_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (size_t i = 0; i < num_of_threads; ++i) {
+    _queues.push_back(std::make_unique<WorkerQueue>());
+  }
+  for (size_t i = 0; i < num_of_threads; ++i) {
+    _threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _has_tasks.notify_all();
+
+  for (auto& thread : _threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::Submit(Task task) {
+  size_t target;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_unfinished;
+    // counted before it is visible in a deque, so _queued never underflows
+    _queued.fetch_add(1);
+    target = current_pool == this ? current_worker
+                                   : _next_queue++ % _queues.size();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_queues[target]->mutex);
+    _queues[target]->tasks.push_back(std::move(task));
+  }
+  _has_tasks.notify_one();
+}
+
+void ThreadPool::SubmitTo(size_t worker, Task task) {
+  assert(worker < _queues.size());
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_unfinished;
+    _queues[worker]->num_of_pinned.fetch_add(1);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_queues[worker]->mutex);
+    _queues[worker]->pinned.push_back(std::move(task));
+  }
+  // notify_one could wake another worker than this one
+  _has_tasks.notify_all();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _all_done.wait(lock, [this] { return _unfinished == 0; });
+
+  if (_exception) {
+    std::rethrow_exception(std::exchange(_exception, nullptr));
+  }
+}
+
+bool ThreadPool::RunPendingTask() {
+  if (!IsWorkerThread()) {
+    return false;
+  }
+
+  size_t index = current_worker;
+  Task task;
+  if (TryPopPinned(index, task)) {
+    _queues[index]->num_of_pinned.fetch_sub(1);
+  } else if (TryPop(index, task) || TrySteal(index, task)) {
+    _queued.fetch_sub(1);
+  } else {
+    return false;
+  }
+
+  RunTask(task);
+  return true;
+}
+
+bool ThreadPool::IsWorkerThread() const {
+  return current_pool == this;
+}
+
+size_t ThreadPool::GetNumOfThreads() const {
+  return _threads.size();
+}
+
+ThreadAffinity ThreadPool::GetAffinity() const {
+  return _affinity;
+}
+
+size_t ThreadPool::GetWorkerNode(size_t worker) const {
+  assert(worker < _queues.size());
+
+  if (_affinity == ThreadAffinity::kNone) {
+    return 0;
+  }
+  return NumaTopology::Get().GetWorkerNode(worker);
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+  current_pool = this;
+  current_worker = index;
+  PinCurrentThread(NumaTopology::Get().GetWorkerCpus(index, _affinity));
+
+  WorkerQueue& queue = *_queues[index];
+  while (true) {
+    if (RunPendingTask()) {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _has_tasks.wait(lock, [this, &queue] {
+      return _stop || _queued.load() > 0 || queue.num_of_pinned.load() > 0;
+    });
+    if (_stop && _queued.load() == 0 && queue.num_of_pinned.load() == 0) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::RunTask(Task& task) {
+  // a throwing task must not take the worker (and the process) down
+  std::exception_ptr exception;
+  try {
+    task();
+  } catch (...) {
+    exception = std::current_exception();
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (exception && !_exception) {
+    _exception = exception;
+  }
+  if (--_unfinished == 0) {
+    _all_done.notify_all();
+  }
+}
+
+bool ThreadPool::TryPopPinned(size_t index, Task& task) {
+  WorkerQueue& queue = *_queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.pinned.empty()) {
+    return false;
+  }
+  task = std::move(queue.pinned.front());
+  queue.pinned.pop_front();
+  return true;
+}
+
+bool ThreadPool::TryPop(size_t index, Task& task) {
+  WorkerQueue& queue = *_queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::TrySteal(size_t index, Task& task) {
+  for (size_t shift = 1; shift < _queues.size(); ++shift) {
+    WorkerQueue& queue = *_queues[(index + shift) % _queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool) : _pool(&pool) {}
+
+TaskGroup::~TaskGroup() {
+  WaitForTasks();
+}
+
+void TaskGroup::Submit(Task task) {
+  _pool->Submit(Wrap(std::move(task)));
+}
+
+void TaskGroup::SubmitTo(size_t worker, Task task) {
+  _pool->SubmitTo(worker, Wrap(std::move(task)));
+}
+
+void TaskGroup::Wait() {
+  WaitForTasks();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_exception) {
+    std::rethrow_exception(std::exchange(_exception, nullptr));
+  }
+}
+
+Task TaskGroup::Wrap(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_unfinished;
+  }
+
+  return [this, task = std::move(task)] {
+    std::exception_ptr exception;
+    try {
+      task();
+    } catch (...) {
+      exception = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (exception && !_exception) {
+      _exception = exception;
+    }
+    if (--_unfinished == 0) {
+      _done.notify_all();
+    }
+  };
+}
+
+void TaskGroup::WaitForTasks() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (!_pool->IsWorkerThread()) {
+    _done.wait(lock, [this] { return _unfinished == 0; });
+    return;
+  }
+
+  // a worker that only slept could wait for its own pinned tasks forever
+  while (_unfinished > 0) {
+    lock.unlock();
+    bool ran = _pool->RunPendingTask();
+    lock.lock();
+    if (!ran) {
+      _done.wait_for(lock, std::chrono::milliseconds(1),
+                     [this] { return _unfinished == 0; });
+    }
+  }
+}
+
+}  // namespace mlp
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "numa.h"
+
+namespace mlp {
+
+using Task = std::function<void()>;
+
+// Work-stealing pool: every worker pops its own deque from the back and
+// steals from the front of the others when it runs dry. Pinned workers
+// spread over the NUMA nodes (see ThreadAffinity), and memory a worker
+// touches first is allocated on its node.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_of_threads = 0,
+                      ThreadAffinity affinity = ThreadAffinity::kNone);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool();
+
+  // tasks submitted from a worker go to that worker's own deque
+  void Submit(Task task);
+
+  // runs the task on the given worker, other workers don't steal it
+  void SubmitTo(size_t worker, Task task);
+
+  // Blocks until every submitted task is finished and rethrows the first
+  // exception a task threw since the last Wait. Must not be called from a
+  // worker; callers sharing the pool wait with a TaskGroup instead.
+  void Wait();
+
+  // Runs one queued task on the calling worker (its pinned tasks first),
+  // false if there is none or the caller isn't a worker of this pool.
+  bool RunPendingTask();
+
+  bool IsWorkerThread() const;
+
+  size_t GetNumOfThreads() const;
+
+  ThreadAffinity GetAffinity() const;
+
+  // NUMA node of the worker, 0 if the workers aren't pinned
+  size_t GetWorkerNode(size_t worker) const;
+
+ private:
+  struct WorkerQueue {
+    std::deque<Task> tasks;
+    // SubmitTo tasks, never stolen
+    std::deque<Task> pinned;
+    std::atomic<size_t> num_of_pinned{0};
+    std::mutex mutex;
+  };
+
+  void WorkerLoop(size_t index);
+
+  void RunTask(Task& task);
+
+  bool TryPopPinned(size_t index, Task& task);
+
+  bool TryPop(size_t index, Task& task);
+
+  bool TrySteal(size_t index, Task& task);
+
+  std::vector<std::unique_ptr<WorkerQueue>> _queues;
+  std::vector<std::thread> _threads;
+  ThreadAffinity _affinity;
+
+  std::mutex _mutex;
+  std::condition_variable _has_tasks;
+  std::condition_variable _all_done;
+  std::atomic<size_t> _queued{0};
+  size_t _unfinished = 0;
+  size_t _next_queue = 0;
+  bool _stop = false;
+  std::exception_ptr _exception;
+};
+
+// Tasks of one caller on a shared pool: Wait waits only for them, so
+// concurrent callers don't block each other, and rethrows what they threw.
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool& pool);
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  // waits for the tasks still running, without rethrowing
+  ~TaskGroup();
+
+  void Submit(Task task);
+
+  void SubmitTo(size_t worker, Task task);
+
+  // Blocks until every task of the group is finished and rethrows the first
+  // exception one of them threw. On a worker of the pool it runs queued
+  // tasks meanwhile, so it may be called from a task.
+  void Wait();
+
+ private:
+  Task Wrap(Task task);
+
+  void WaitForTasks();
+
+  ThreadPool* _pool;
+  std::mutex _mutex;
+  std::condition_variable _done;
+  size_t _unfinished = 0;
+  std::exception_ptr _exception;
+};
+
+}  // namespace mlp
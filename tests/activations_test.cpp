@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../src/kernels.h"
+#include "test_util.h"
+
+namespace {
+
+using mlp::kernels::Isa;
+
+// [-50, 50] with a step that doesn't hit the reduction points exactly, plus
+// the ends of the clamped range
+mlp::Vector TestPoints() {
+  std::vector<double> points;
+  for (double x = -50; x <= 50; x += 0.0137) {
+    points.push_back(x);
+  }
+  points.push_back(-708);
+  points.push_back(709);
+  points.push_back(-800);
+  return mlp::to_Vector(points);
+}
+
+}  // namespace
+
+TEST(ActivationsTest, ExpApproxRelativeError) {
+  mlp::Vector x = TestPoints();
+
+  for (Isa isa : {Isa::kGeneric, Isa::kSse42, Isa::kAvx2, Isa::kAvx512}) {
+    if (!mlp::kernels::IsIsaSupported(isa)) {
+      continue;
+    }
+    SCOPED_TRACE(mlp::kernels::GetIsaName(isa));
+
+    mlp::Vector y(x.size());
+    mlp::kernels::GetKernelTable(isa).exp_approx(x.data(), x.size(), y.data());
+
+    for (ssize_t i = 0; i < x.size(); ++i) {
+      double expected = std::exp(std::max(x[i], -708.0));
+      EXPECT_LE(std::abs(y[i] - expected), 2e-7 * expected) << x[i];
+    }
+  }
+}
+
+TEST(ActivationsTest, FastActivationsError) {
+  using namespace mlp::activation_functions;
+
+  mlp::Vector x = TestPoints().head(7300);
+
+  EXPECT_LE((fast_sigmoid(x) - sigmoid(x)).cwiseAbs().maxCoeff(), 1e-7);
+  EXPECT_LE((fast_tanh(x) - tanh(x)).cwiseAbs().maxCoeff(), 1e-7);
+
+  mlp::Vector z = x.head(64) / 10;
+  mlp::Vector exact = softmax(z);
+  EXPECT_LE(((fast_softmax(z) - exact).array() / exact.array())
+                .abs()
+                .maxCoeff(),
+            1e-6);
+}
+
+TEST(ActivationsTest, DerivativeFromOutputMatches) {
+  mlp::ActivationFunctionsList list;
+  mlp::Vector x = mlp::Vector::Random(12) * 5;
+
+  for (const std::string name : {"sigmoid", "tanh", "softmax"}) {
+    SCOPED_TRACE(name);
+    mlp::ActivationFunction f = list.GetByName(name);
+    ASSERT_EQ(f.GetName(), name);
+
+    mlp::Matrix expected = f.ComputeDerivative(x);
+    mlp::Matrix actual = f.ComputeDerivative(x, f.Compute(x));
+    EXPECT_LE((expected - actual).cwiseAbs().maxCoeff(), 1e-12);
+  }
+
+  // the output has no closed-form derivative of relu, x is used instead
+  mlp::ActivationFunction relu = list.GetByName("relu");
+  EXPECT_EQ(relu.ComputeDerivative(x, relu.Compute(x)),
+            relu.ComputeDerivative(x));
+}
+
+TEST(ActivationsTest, FastActivationsKeepAccuracy) {
+  mlp::DataSet input, output;
+  test_util::MakePrototypeDataSet(2000, 20, 4, 0.3, 7, input, output);
+
+  mlp::MultilayerPerceptron exact =
+      test_util::MakeModel({20, 16, 4}, 1, {"tanh", "sigmoid"});
+  exact.SetBatchSize(20);
+  mlp::MultilayerPerceptron fast = exact;
+  fast.SetFastActivations(true);
+
+  exact.Train(5, input, output);
+  fast.Train(5, input, output);
+
+  double exact_accuracy = exact.CalculateAccuracy(input, output);
+  double fast_accuracy = fast.CalculateAccuracy(input, output);
+  EXPECT_GT(exact_accuracy, 0.9);
+  EXPECT_NEAR(fast_accuracy, exact_accuracy, 0.01);
+
+  // switching back gives the exact model with the trained weights
+  fast.SetFastActivations(false);
+  mlp::Vector sample = mlp::to_Vector(input[0]);
+  mlp::Vector fast_result = fast.Calculate(sample);
+  fast.SetFastActivations(true);
+  EXPECT_LE((fast.Calculate(sample) - fast_result).cwiseAbs().maxCoeff(),
+            1e-6);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+
+#include <string>
+
+#include "test_util.h"
+
+namespace {
+
+double MeanLoss(const mlp::MultilayerPerceptron& model,
+                const mlp::DataSet& input, const mlp::DataSet& output) {
+  mlp::LossFunction loss = mlp::LossFunctionsList().GetByName("square");
+  double sum = 0.0;
+  for (size_t i = 0; i < input.size(); ++i) {
+    sum += loss.CalculateLoss(model.Calculate(mlp::to_Vector(input[i])),
+                              mlp::to_Vector(output[i]));
+  }
+  return sum / static_cast<double>(input.size());
+}
+
+}  // namespace
+
+TEST(AsyncTrainingTest, LearnsLikeSyncTrain) {
+  mlp::DataSet input, output;
+  test_util::MakeSeparableDataSet(400, 4, 17, input, output);
+
+  mlp::MultilayerPerceptron sync = test_util::MakeModel({4, 8, 2}, 4);
+  double initial_loss = MeanLoss(sync, input, output);
+  sync.Train(200, input, output);
+  double sync_accuracy = sync.CalculateAccuracy(input, output);
+  ASSERT_GT(sync_accuracy, 0.9);
+
+  for (size_t threads : {1, 4}) {
+    for (size_t staleness : {0, 2}) {
+      SCOPED_TRACE(std::to_string(threads) + " threads, staleness " +
+                   std::to_string(staleness));
+
+      mlp::AsyncTrainingOptions options;
+      options.num_of_threads = threads;
+      options.local_batch_size = 4;
+      options.max_staleness = staleness;
+
+      mlp::MultilayerPerceptron model = test_util::MakeModel({4, 8, 2}, 4);
+      model.TrainAsync(200, input, output, options);
+
+      EXPECT_LT(MeanLoss(model, input, output), initial_loss);
+      EXPECT_GT(model.CalculateAccuracy(input, output), sync_accuracy - 0.05);
+    }
+  }
+}
+
+// Many workers with single sample batches collide on every weight. Meant to
+// be run under -fsanitize=thread as well, which must stay quiet.
+TEST(AsyncTrainingTest, WorkersDontRaceOnTheWeights) {
+  mlp::DataSet input, output;
+  test_util::MakeSeparableDataSet(200, 4, 17, input, output);
+
+  for (bool place_data : {false, true}) {
+    mlp::AsyncTrainingOptions options;
+    options.num_of_threads = 8;
+    options.max_staleness = place_data ? 1 : 0;
+    options.place_data_on_workers = place_data;
+
+    mlp::MultilayerPerceptron model = test_util::MakeModel({4, 8, 2}, 4);
+    double initial_loss = MeanLoss(model, input, output);
+    model.TrainAsync(5, input, output, options);
+    EXPECT_LT(MeanLoss(model, input, output), initial_loss);
+  }
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <mlp/codegen.h>
+#include <mlp/mlp.h>
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+// generated from MLP_V1_MODEL_PATH at build time, see CMakeLists.txt
+#include "v1_model.h"
+
+TEST(CodegenTest, PredictMatchesCalculate) {
+  mlp::MultilayerPerceptron model;
+  model.LoadModel(MLP_V1_MODEL_PATH, mlp::ActivationFunctionsList(),
+                  mlp::LossFunctionsList());
+  ASSERT_EQ(model.GetNumOfLayers(), 3u);
+  ASSERT_EQ(static_cast<size_t>(model.GetInputSize()), v1_model::kInputSize);
+  ASSERT_EQ(static_cast<size_t>(model.GetOutputSize()), v1_model::kOutputSize);
+
+  std::srand(17);
+  for (int sample = 0; sample < 100; ++sample) {
+    // pixels in [0, 1] like the digits data set
+    mlp::Vector input =
+        (mlp::Vector::Random(model.GetInputSize()).array() + 1.0) / 2.0;
+    mlp::Vector expected = model.Calculate(input);
+
+    double output[v1_model::kOutputSize];
+    v1_model::predict(input.data(), output);
+
+    // only the summation order differs from Calculate
+    for (size_t i = 0; i < v1_model::kOutputSize; ++i) {
+      EXPECT_NEAR(output[i], expected[static_cast<ssize_t>(i)], 1e-12);
+    }
+  }
+}
+
+TEST(CodegenTest, RejectsUnknownActivations) {
+  mlp::ActivationFunctionsList act_list;
+  act_list.InsertFunction(
+      [](const mlp::Vector& x) -> mlp::Vector { return 2.0 * x; },
+      [](const mlp::Vector& x) -> mlp::Matrix {
+        return mlp::Matrix::Identity(x.size(), x.size()) * 2.0;
+      },
+      "double");
+
+  mlp::MultilayerPerceptron model({3, 2}, {act_list.GetByName("double")},
+                                  mlp::LossFunctionsList().GetByName("square"));
+  std::ostringstream out;
+  EXPECT_FALSE(mlp::GenerateModelHeader(out, model));
+
+  model = mlp::MultilayerPerceptron(
+      {3, 2}, {act_list.GetByName("fast_tanh")},
+      mlp::LossFunctionsList().GetByName("square"));
+  mlp::CodegenOptions options;
+  options.name_space = "tiny";
+  EXPECT_TRUE(mlp::GenerateModelHeader(out, model, options));
+  EXPECT_NE(out.str().find("namespace tiny {"), std::string::npos);
+  EXPECT_NE(out.str().find("std::tanh"), std::string::npos);
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+
+#include "test_util.h"
+
+namespace {
+
+mlp::MultilayerPerceptron MakeModel() {
+  return test_util::MakeModel({4, 6, 5, 2}, 9, {"tanh", "tanh", "softmax"});
+}
+
+// the outputs of the model for every sample, one per column
+mlp::Matrix Outputs(const mlp::MultilayerPerceptron& model,
+                    const mlp::DataSet& input) {
+  mlp::Matrix outputs(2, static_cast<ssize_t>(input.size()));
+  for (size_t i = 0; i < input.size(); ++i) {
+    outputs.col(static_cast<ssize_t>(i)) =
+        model.Calculate(mlp::to_Vector(input[i]));
+  }
+  return outputs;
+}
+
+}  // namespace
+
+TEST(FrozenLayersTest, CachedPrefixTrainsLikeUncached) {
+  mlp::DataSet input, output;
+  test_util::MakeDataSet(24, 4, 2, 1, input, output);
+
+  mlp::MultilayerPerceptron cached = MakeModel();
+  cached.FreezeLayer(0);
+  cached.FreezeLayer(1);
+  mlp::MultilayerPerceptron uncached = cached;
+  uncached.SetFrozenPrefixCaching(false);
+
+  mlp::Matrix initial = Outputs(cached, input);
+  cached.Train(3, input, output);
+  uncached.Train(3, input, output);
+  EXPECT_NE(Outputs(cached, input), initial);
+  EXPECT_EQ(Outputs(cached, input), Outputs(uncached, input));
+}
+
+TEST(FrozenLayersTest, FrozenLayersKeepTheirBits) {
+  mlp::DataSet input, output;
+  test_util::MakeDataSet(24, 4, 2, 2, input, output);
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  for (size_t i = 0; i < 3; ++i) {
+    model.FreezeLayer(i);
+  }
+  mlp::Matrix initial = Outputs(model, input);
+
+  model.Train(3, input, output);
+  EXPECT_TRUE(model.IsLayerFrozen(1));
+  EXPECT_EQ(Outputs(model, input), initial);
+
+  model.UnfreezeLayer(1);
+  EXPECT_FALSE(model.IsLayerFrozen(1));
+  EXPECT_TRUE(model.IsLayerFrozen(2));
+  model.Train(1, input, output);
+  EXPECT_NE(Outputs(model, input), initial);
+}
+
+TEST(FrozenLayersTest, CacheFollowsTheDataSet) {
+  mlp::DataSet first_input, first_output, second_input, second_output;
+  test_util::MakeDataSet(24, 4, 2, 3, first_input, first_output);
+  test_util::MakeDataSet(24, 4, 2, 4, second_input, second_output);
+
+  mlp::MultilayerPerceptron cached = MakeModel();
+  cached.FreezeLayer(0);
+  mlp::MultilayerPerceptron uncached = cached;
+  uncached.SetFrozenPrefixCaching(false);
+
+  cached.Train(2, first_input, first_output);
+  uncached.Train(2, first_input, first_output);
+  cached.Train(2, second_input, second_output);
+  uncached.Train(2, second_input, second_output);
+
+  EXPECT_EQ(Outputs(cached, first_input), Outputs(uncached, first_input));
+}
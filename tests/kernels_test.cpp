@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/kernels.h"
+
+namespace {
+
+using mlp::kernels::Isa;
+
+struct Shape {
+  ssize_t rows;
+  ssize_t cols;
+};
+
+// the skinny shapes of the digits example plus odd sizes for the tails
+const std::vector<Shape> shapes = {{16, 784}, {784, 16}, {16, 16}, {10, 16},
+                                   {1, 1},    {7, 13},   {33, 5},  {64, 300}};
+
+std::vector<Isa> SupportedIsas() {
+  std::vector<Isa> isas;
+  for (Isa isa : {Isa::kGeneric, Isa::kSse42, Isa::kAvx2, Isa::kAvx512}) {
+    if (mlp::kernels::IsIsaSupported(isa)) {
+      isas.push_back(isa);
+    }
+  }
+  return isas;
+}
+
+std::string Name(Isa isa, const Shape& shape) {
+  return std::string(mlp::kernels::GetIsaName(isa)) + " " +
+         std::to_string(shape.rows) + "x" + std::to_string(shape.cols);
+}
+
+const double tolerance = 1e-10;
+
+}  // namespace
+
+TEST(KernelsTest, GemvMatchesEigen) {
+  for (Isa isa : SupportedIsas()) {
+    for (const auto& shape : shapes) {
+      SCOPED_TRACE(Name(isa, shape));
+
+      mlp::Matrix A = mlp::Matrix::Random(shape.rows, shape.cols);
+      mlp::Vector x = mlp::Vector::Random(shape.cols);
+      mlp::Vector b = mlp::Vector::Random(shape.rows);
+      mlp::Vector y(shape.rows);
+
+      mlp::kernels::GetKernelTable(isa).gemv(A.data(), shape.rows, shape.cols,
+                                             x.data(), b.data(), y.data());
+
+      EXPECT_LT((y - (A * x + b)).cwiseAbs().maxCoeff(), tolerance);
+    }
+  }
+}
+
+TEST(KernelsTest, GemvTransposedMatchesEigen) {
+  for (Isa isa : SupportedIsas()) {
+    for (const auto& shape : shapes) {
+      SCOPED_TRACE(Name(isa, shape));
+
+      mlp::Matrix A = mlp::Matrix::Random(shape.rows, shape.cols);
+      mlp::Vector v = mlp::Vector::Random(shape.rows);
+      mlp::Vector r(shape.cols);
+
+      mlp::kernels::GetKernelTable(isa).gemv_transposed(
+          A.data(), shape.rows, shape.cols, v.data(), r.data());
+
+      EXPECT_LT((r - A.transpose() * v).cwiseAbs().maxCoeff(), tolerance);
+    }
+  }
+}
+
+TEST(KernelsTest, Rank1UpdateMatchesEigen) {
+  for (Isa isa : SupportedIsas()) {
+    for (const auto& shape : shapes) {
+      SCOPED_TRACE(Name(isa, shape));
+
+      mlp::Matrix A = mlp::Matrix::Random(shape.rows, shape.cols);
+      mlp::Vector u = mlp::Vector::Random(shape.rows);
+      mlp::Vector z = mlp::Vector::Random(shape.cols);
+      mlp::Matrix expected = A + u * z.transpose();
+
+      mlp::kernels::GetKernelTable(isa).rank1_update(
+          A.data(), shape.rows, shape.cols, u.data(), z.data());
+
+      EXPECT_LT((A - expected).cwiseAbs().maxCoeff(), tolerance);
+    }
+  }
+}
+
+TEST(KernelsTest, ActiveIsaIsSupported) {
+  EXPECT_TRUE(mlp::kernels::IsIsaSupported(mlp::kernels::GetActiveIsa()));
+}
+
+namespace {
+
+// every third column, as relu outputs with a third of the units active
+std::vector<ssize_t> EveryThirdColumn(ssize_t cols) {
+  std::vector<ssize_t> nz;
+  for (ssize_t j = 1; j < cols; j += 3) {
+    nz.push_back(j);
+  }
+  return nz;
+}
+
+mlp::Vector KeepColumns(const mlp::Vector& x, const std::vector<ssize_t>& nz) {
+  mlp::Vector result = mlp::Vector::Zero(x.size());
+  for (ssize_t j : nz) {
+    result[j] = x[j];
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(KernelsTest, SparseKernelsMatchEigen) {
+  for (Isa isa : SupportedIsas()) {
+    for (const auto& shape : shapes) {
+      SCOPED_TRACE(Name(isa, shape));
+      const auto& table = mlp::kernels::GetKernelTable(isa);
+
+      std::vector<ssize_t> nz = EveryThirdColumn(shape.cols);
+      ssize_t num_of_nz = static_cast<ssize_t>(nz.size());
+      mlp::Matrix A = mlp::Matrix::Random(shape.rows, shape.cols);
+      mlp::Vector x = KeepColumns(mlp::Vector::Random(shape.cols), nz);
+      mlp::Vector b = mlp::Vector::Random(shape.rows);
+      mlp::Vector v = mlp::Vector::Random(shape.rows);
+
+      mlp::Vector y(shape.rows);
+      table.sparse_gemv(A.data(), shape.rows, shape.cols, nz.data(),
+                        num_of_nz, x.data(), b.data(), y.data());
+      EXPECT_LT((y - (A * x + b)).cwiseAbs().maxCoeff(), tolerance);
+
+      mlp::Vector r = mlp::Vector::Random(shape.cols);
+      table.sparse_gemv_transposed(A.data(), shape.rows, shape.cols,
+                                   nz.data(), num_of_nz, v.data(), r.data());
+      mlp::Vector expected = KeepColumns(A.transpose() * v, nz);
+      EXPECT_LT((r - expected).cwiseAbs().maxCoeff(), tolerance);
+
+      mlp::Matrix updated = A + v * x.transpose();
+      table.sparse_rank1_update(A.data(), shape.rows, shape.cols, nz.data(),
+                                num_of_nz, v.data(), x.data());
+      EXPECT_LT((A - updated).cwiseAbs().maxCoeff(), tolerance);
+    }
+  }
+}
+
+TEST(KernelsTest, FindNonZerosFollowsDensity) {
+  const double x[8] = {0.0, 1.0, 0.0, 0.0, -2.0, 0.0, 3.0, 0.0};
+  ssize_t nz[8];
+  double density = mlp::kernels::GetSparseDensity();
+
+  mlp::kernels::SetSparseDensity(0.5);
+  ASSERT_EQ(mlp::kernels::FindNonZeros(x, 8, nz), 3);
+  EXPECT_EQ(nz[0], 1);
+  EXPECT_EQ(nz[1], 4);
+  EXPECT_EQ(nz[2], 6);
+
+  mlp::kernels::SetSparseDensity(0.25);
+  EXPECT_EQ(mlp::kernels::FindNonZeros(x, 8, nz), -1);
+
+  mlp::kernels::SetSparseDensity(0.0);
+  EXPECT_EQ(mlp::kernels::FindNonZeros(x, 8, nz), -1);
+
+  mlp::kernels::SetSparseDensity(density);
+}
+
+TEST(KernelsTest, SparseReluLayersTrainLikeDense) {
+  mlp::ActivationFunctionsList act_list;
+  mlp::ActivationFunction relu = act_list.GetByName("relu");
+
+  mlp::DataSet input, output;
+  std::srand(3);
+  for (size_t i = 0; i < 30; ++i) {
+    mlp::Vector x = mlp::Vector::Random(20).cwiseMax(0.0);
+    input.emplace_back(x.data(), x.data() + x.size());
+    output.emplace_back(4, 0.0);
+    output.back()[i % 4] = 1.0;
+  }
+
+  std::srand(5);
+  mlp::MultilayerPerceptron dense(
+      {20, 32, 32, 4}, {relu, relu, act_list.GetByName("softmax")},
+      mlp::LossFunctionsList().GetByName("square"));
+  dense.SetBatchSize(5);
+  mlp::MultilayerPerceptron sparse = dense;
+  double density = mlp::kernels::GetSparseDensity();
+
+  mlp::kernels::SetSparseDensity(0.0);
+  dense.Train(3, input, output);
+  mlp::Vector dense_output = dense.Calculate(mlp::to_Vector(input[0]));
+
+  mlp::kernels::SetSparseDensity(1.0);
+  sparse.Train(3, input, output);
+  mlp::Vector sparse_output = sparse.Calculate(mlp::to_Vector(input[0]));
+
+  mlp::kernels::SetSparseDensity(density);
+
+  EXPECT_LT((sparse.GetParameterSpan() - dense.GetParameterSpan())
+                .cwiseAbs()
+                .maxCoeff(),
+            tolerance);
+  EXPECT_LT((sparse_output - dense_output).cwiseAbs().maxCoeff(), tolerance);
+}
+
+TEST(KernelsTest, SparseGradientIsAnActivationProperty) {
+  mlp::ActivationFunctionsList act_list;
+  EXPECT_TRUE(act_list.GetByName("relu").HasSparseGradient());
+  EXPECT_FALSE(act_list.GetByName("tanh").HasSparseGradient());
+  EXPECT_FALSE(act_list.GetByName("identity").HasSparseGradient());
+
+  // a relu under another name takes the sparse path as well
+  act_list.InsertFunction(mlp::activation_functions::relu,
+                          mlp::activation_functions::relu_der, "my_relu",
+                          true);
+  mlp::ActivationFunction my_relu = act_list.GetByName("my_relu");
+  EXPECT_TRUE(mlp::NonLinearLayer(my_relu).HasSparseGradient());
+
+  mlp::MultilayerPerceptron model(
+      {6, 8, 3}, {my_relu, act_list.GetByName("softmax")},
+      mlp::LossFunctionsList().GetByName("square"));
+  EXPECT_TRUE(model.GetNonLinearLayer(0).HasSparseGradient());
+  EXPECT_FALSE(model.GetNonLinearLayer(1).HasSparseGradient());
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <mlp/codegen.h>
+#include <mlp/mlp.h>
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+
+#include "test_util.h"
+
+namespace {
+
+// 20 -> 12 -> 3 model whose first A has rank 2
+mlp::MultilayerPerceptron MakeModel() {
+  mlp::MultilayerPerceptron model = test_util::MakeModel({20, 12, 3}, 5);
+
+  mlp::Matrix low_rank =
+      mlp::Matrix::Random(12, 2) * mlp::Matrix::Random(2, 20);
+  // A of the first layer starts the parameter span
+  Eigen::Map<mlp::Matrix>(model.GetParameterSpan().data(), 12, 20) = low_rank;
+  return model;
+}
+
+}  // namespace
+
+TEST(LowRankTest, ExactRankKeepsOutputs) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::MultilayerPerceptron original = model;
+
+  mlp::LowRankOptions options;
+  options.energy = 1.0 - 1e-12;
+  ASSERT_EQ(model.FactorizeLayer(0, options), 2u);
+
+  ASSERT_EQ(model.GetNumOfLayers(), 3u);
+  EXPECT_EQ(model.GetLinearLayer(0).GetOutputSize(), 2);
+  EXPECT_EQ(model.GetLinearLayer(1).GetInputSize(), 2);
+  EXPECT_EQ(model.GetLinearLayer(1).GetOutputSize(), 12);
+  EXPECT_EQ(model.GetNonLinearLayer(0).GetActivatioFunc().GetName(),
+            "identity");
+  EXPECT_EQ(model.GetNonLinearLayer(1).GetActivatioFunc().GetName(), "relu");
+
+  for (int i = 0; i < 20; ++i) {
+    mlp::Vector input = mlp::Vector::Random(20);
+    EXPECT_LE((model.Calculate(input) - original.Calculate(input))
+                  .cwiseAbs()
+                  .maxCoeff(),
+              1e-12);
+  }
+}
+
+TEST(LowRankTest, KeepsModelWhenNotCheaper) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::Vector parameters = model.GetParameterSpan();
+
+  // k * (12 + 3) < 12 * 3 only for k <= 2
+  mlp::LowRankOptions options;
+  options.energy = 1.0;
+  options.max_rank = 1;
+  EXPECT_EQ(model.FactorizeLayer(1, options), 0u);
+  EXPECT_EQ(model.GetNumOfLayers(), 2u);
+  EXPECT_EQ(model.GetParameterSpan(), parameters);
+
+  // a random 12 x 20 matrix needs all 12 > 7 singular values
+  options.max_rank = 0;
+  mlp::MultilayerPerceptron full_rank(
+      {20, 12}, {mlp::ActivationFunction()},
+      mlp::LossFunctionsList().GetByName("square"));
+  EXPECT_EQ(full_rank.FactorizeLayer(0, options), 0u);
+  EXPECT_EQ(full_rank.GetNumOfLayers(), 1u);
+}
+
+TEST(LowRankTest, AccuracyBudgetAndFineTuning) {
+  mlp::DataSet input, output;
+  test_util::MakePrototypeDataSet(300, 20, 3, 0.1, 9, input, output);
+
+  std::srand(3);
+  mlp::ActivationFunctionsList act_list;
+  mlp::MultilayerPerceptron model(
+      {20, 16, 3}, {act_list.GetByName("relu"), act_list.GetByName("softmax")},
+      mlp::LossFunctionsList().GetByName("square"));
+  model.SetBatchSize(10);
+  model.Train(30, input, output);
+  double accuracy = model.CalculateAccuracy(input, output);
+  ASSERT_GT(accuracy, 0.9);
+
+  size_t rank = model.FactorizeLayer(0, 0.0, input, output);
+  ASSERT_GT(rank, 0u);
+  EXPECT_LE(rank, 20u * 16u / (20u + 16u));
+  EXPECT_GE(model.CalculateAccuracy(input, output), accuracy);
+
+  // the factors train like any other layer
+  mlp::Vector before = model.GetParameterSpan();
+  model.Train(2, input, output);
+  EXPECT_NE(model.GetParameterSpan(), before);
+  EXPECT_GE(model.CalculateAccuracy(input, output), 0.9);
+}
+
+TEST(LowRankTest, FactorizedModelRoundTrips) {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mlp-low-rank-" + std::to_string(getpid())))
+                         .string();
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  model.FreezeLayer(1);
+  ASSERT_EQ(model.FactorizeLayer(0), 2u);
+  EXPECT_FALSE(model.IsLayerFrozen(0));
+  EXPECT_TRUE(model.IsLayerFrozen(2));
+  model.SaveModel(path);
+
+  mlp::MultilayerPerceptron loaded;
+  loaded.LoadModel(path, mlp::ActivationFunctionsList(),
+                   mlp::LossFunctionsList());
+  std::filesystem::remove(path);
+
+  ASSERT_EQ(loaded.GetNumOfLayers(), 3u);
+  mlp::Vector input = mlp::Vector::Random(20);
+  EXPECT_EQ(loaded.Calculate(input), model.Calculate(input));
+
+  std::ostringstream header;
+  EXPECT_TRUE(mlp::GenerateModelHeader(header, loaded));
+}
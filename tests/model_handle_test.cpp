@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <mlp/model_handle.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+mlp::MultilayerPerceptron MakeModel() {
+  mlp::MultilayerPerceptron model = test_util::MakeModel({6, 8, 3}, 21);
+  model.SetBatchSize(5);
+  return model;
+}
+
+}  // namespace
+
+TEST(ModelHandleTest, ReaderFollowsPublishedVersions) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::ModelHandle handle(model);
+  mlp::ModelHandle::Reader reader(handle);
+  EXPECT_EQ(handle.GetVersion(), 1u);
+  EXPECT_EQ(reader.GetVersion(), 1u);
+
+  mlp::Vector input = mlp::Vector::Random(6);
+  const mlp::MultilayerPerceptron* first = &reader.Get();
+  mlp::Vector first_result = first->Calculate(input);
+
+  // the snapshot doesn't change with the trained model
+  model.GetParameterSpan().setZero();
+  EXPECT_EQ(reader.Get().Calculate(input), first_result);
+  EXPECT_EQ(&reader.Get(), first);
+
+  handle.Publish(model);
+  EXPECT_EQ(handle.GetVersion(), 2u);
+  EXPECT_EQ(reader.Get().Calculate(input), model.Calculate(input));
+  EXPECT_EQ(reader.GetVersion(), 2u);
+}
+
+TEST(ModelHandleTest, OldVersionsLiveWhileRead) {
+  mlp::ModelHandle handle(MakeModel());
+  std::shared_ptr<const mlp::MultilayerPerceptron> old = handle.Get();
+  std::weak_ptr<const mlp::MultilayerPerceptron> weak = old;
+
+  handle.Publish(MakeModel());
+  EXPECT_FALSE(weak.expired());
+  EXPECT_NE(handle.Get(), old);
+
+  old.reset();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST(ModelHandleTest, PublisherPublishesEveryNUpdates) {
+  mlp::DataSet input, output;
+  test_util::MakeDataSet(50, 6, 3, 4, input, output);
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::ModelHandle handle(model);
+  model.SetUpdateCallback(handle.MakePublisher(3));
+
+  // 10 batches of 5 samples
+  model.Train(1, input, output);
+  EXPECT_EQ(handle.GetVersion(), 1u + 10 / 3);
+
+  model.Train(1, input, output);
+  EXPECT_EQ(handle.GetVersion(), 1u + 20 / 3);
+  // the last two updates aren't published yet
+  mlp::Vector x = mlp::Vector::Random(6);
+  EXPECT_NE(handle.Get()->Calculate(x), model.Calculate(x));
+
+  handle.Publish(model);
+  EXPECT_EQ(handle.Get()->Calculate(x), model.Calculate(x));
+}
+
+TEST(ModelHandleTest, ConcurrentReadersSeeWholeSnapshots) {
+  mlp::DataSet input, output;
+  test_util::MakeDataSet(100, 6, 3, 4, input, output);
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::ModelHandle handle(model);
+  model.SetUpdateCallback(handle.MakePublisher(1));
+
+  std::atomic<bool> done{false};
+  std::atomic<size_t> mismatches{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; ++r) {
+    readers.emplace_back([&] {
+      mlp::ModelHandle::Reader reader(handle);
+      mlp::Vector x = mlp::Vector::Constant(6, 0.5);
+      uint64_t last_version = 0;
+      while (!done.load()) {
+        // a torn model would give different results for the same input
+        const mlp::MultilayerPerceptron& snapshot = reader.Get();
+        mlp::Vector result = snapshot.Calculate(x);
+        std::this_thread::yield();
+        mismatches += snapshot.Calculate(x) != result;
+        mismatches += reader.GetVersion() < last_version;
+        last_version = reader.GetVersion();
+      }
+    });
+  }
+
+  model.Train(20, input, output);
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(mismatches.load(), 0u);
+  EXPECT_EQ(handle.GetVersion(), 1u + 20 * 100 / 5);
+}
+
+TEST(ModelHandleTest, SnapshotsHaveNoGradients) {
+  mlp::DataSet input, output;
+  test_util::MakeDataSet(10, 6, 3, 4, input, output);
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  model.FreezeLayer(0);
+  model.Train(1, input, output);
+  mlp::ModelHandle handle(model);
+
+  std::shared_ptr<const mlp::MultilayerPerceptron> snapshot = handle.Get();
+  mlp::MultilayerPerceptron released = model;
+  released.ReleaseGradients();
+  EXPECT_EQ(snapshot->GetMemoryUsage(), released.GetMemoryUsage());
+  EXPECT_LT(snapshot->GetMemoryUsage(), model.GetMemoryUsage());
+  EXPECT_TRUE(snapshot->IsLayerFrozen(0));
+  EXPECT_EQ(snapshot->GetBatchSize(), model.GetBatchSize());
+  EXPECT_EQ(snapshot->Calculate(mlp::to_Vector(input[0])),
+            model.Calculate(mlp::to_Vector(input[0])));
+}
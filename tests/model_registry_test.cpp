@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <mlp/model_registry.h>
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class ModelRegistryTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    _dir = std::filesystem::temp_directory_path() /
+           ("mlp-registry-" + std::to_string(getpid()));
+    std::filesystem::create_directories(_dir);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(_dir); }
+
+  // 5 -> hidden -> 2 model saved as name
+  std::string SaveModel(const std::string& name, ssize_t hidden) {
+    mlp::ActivationFunctionsList act_list;
+    mlp::LossFunctionsList loss_list;
+    mlp::MultilayerPerceptron model(
+        {5, hidden, 2},
+        {act_list.GetByName("relu"), act_list.GetByName("softmax")},
+        loss_list.GetByName("square"));
+
+    std::string path = (_dir / name).string();
+    model.SaveModel(path);
+    return path;
+  }
+
+  std::filesystem::path _dir;
+};
+
+}  // namespace
+
+TEST_F(ModelRegistryTest, LoadsLazilyWithoutGradients) {
+  std::string path = SaveModel("a", 8);
+  mlp::MultilayerPerceptron expected;
+  expected.LoadModel(path, {}, {});
+
+  mlp::ModelRegistry registry;
+  registry.Register("a", path);
+  EXPECT_EQ(registry.GetStats().num_of_models, 0u);
+
+  auto model = registry.Get("a");
+  ASSERT_NE(model, nullptr);
+  mlp::Vector input = mlp::Vector::Random(5);
+  EXPECT_EQ(model->Calculate(input), expected.Calculate(input));
+  EXPECT_EQ(model->GetMemoryUsage(), expected.GetMemoryUsage());
+  // training allocates the gradients
+  expected.GetGradientSpan();
+  EXPECT_EQ(model->GetMemoryUsage() * 2, expected.GetMemoryUsage());
+
+  // the name and the path share the entry
+  EXPECT_EQ(registry.Get(path), model);
+  EXPECT_EQ(registry.Get("a"), model);
+
+  mlp::ModelRegistryStats stats = registry.GetStats();
+  EXPECT_EQ(stats.misses, 1u);
+  EXPECT_EQ(stats.hits, 2u);
+  EXPECT_EQ(stats.num_of_models, 1u);
+  EXPECT_EQ(stats.memory_usage, model->GetMemoryUsage());
+}
+
+TEST_F(ModelRegistryTest, EvictsLeastRecentlyUsed) {
+  std::string a = SaveModel("a", 8);
+  std::string b = SaveModel("b", 8);
+  std::string c = SaveModel("c", 8);
+
+  mlp::ModelRegistry probe;
+  size_t size = probe.Get(a)->GetMemoryUsage();
+
+  mlp::ModelRegistryOptions options;
+  options.memory_budget = 2 * size;
+  mlp::ModelRegistry registry(options);
+
+  auto held = registry.Get(a);
+  registry.Get(b);
+  registry.Get(a);
+  registry.Get(c);
+
+  // b was the least recently used
+  mlp::ModelRegistryStats stats = registry.GetStats();
+  EXPECT_EQ(stats.evictions, 1u);
+  EXPECT_EQ(stats.num_of_models, 2u);
+  EXPECT_LE(stats.memory_usage, options.memory_budget);
+
+  registry.Get(a);
+  EXPECT_EQ(registry.GetStats().misses, 3u);
+  registry.Get(b);
+  EXPECT_EQ(registry.GetStats().misses, 4u);
+
+  // evicted models stay valid for their holders
+  EXPECT_TRUE(registry.Evict(a));
+  EXPECT_FALSE(registry.Evict(a));
+  EXPECT_EQ(held->Calculate(mlp::Vector::Zero(5)).size(), 2);
+}
+
+TEST_F(ModelRegistryTest, ConcurrentGetsLoadOnce) {
+  std::string path = SaveModel("big", 512);
+  mlp::ModelRegistry registry;
+
+  std::vector<std::shared_ptr<const mlp::MultilayerPerceptron>> models(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < models.size(); ++i) {
+    threads.emplace_back([&, i] { models[i] = registry.Get(path); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_NE(models[0], nullptr);
+  for (const auto& model : models) {
+    EXPECT_EQ(model, models[0]);
+  }
+  EXPECT_EQ(registry.GetStats().misses, 1u);
+  EXPECT_EQ(registry.GetStats().hits, models.size() - 1);
+}
+
+TEST_F(ModelRegistryTest, MissingModelIsNotCached) {
+  mlp::ModelRegistry registry;
+  EXPECT_EQ(registry.Get((_dir / "missing").string()), nullptr);
+  EXPECT_EQ(registry.Get((_dir / "missing").string()), nullptr);
+
+  mlp::ModelRegistryStats stats = registry.GetStats();
+  EXPECT_EQ(stats.misses, 2u);
+  EXPECT_EQ(stats.num_of_models, 0u);
+}
+
+TEST_F(ModelRegistryTest, CorruptModelIsNotCached) {
+  // a layer count far beyond any memory
+  std::string path = (_dir / "corrupt").string();
+  {
+    std::ofstream out(path, std::ios::binary);
+    size_t num_of_layers = size_t(1) << 62;
+    out.write(reinterpret_cast<char*>(&num_of_layers), sizeof(num_of_layers));
+  }
+
+  mlp::ModelRegistry registry;
+  registry.Register("corrupt", path);
+  EXPECT_EQ(registry.Get("corrupt"), nullptr);
+  EXPECT_EQ(registry.Get("corrupt"), nullptr);
+  EXPECT_EQ(registry.GetStats().misses, 2u);
+  EXPECT_EQ(registry.GetStats().num_of_models, 0u);
+
+  // fixed on disk, so the next Get loads it
+  SaveModel("corrupt", 3);
+  EXPECT_NE(registry.Get("corrupt"), nullptr);
+}
+
+TEST_F(ModelRegistryTest, RejectsCorruptModels) {
+  std::string path = SaveModel("a", 4);
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), {});
+  }
+
+  // the layer count and the input and output sizes come first
+  std::string huge_layer = bytes;
+  ssize_t rows = ssize_t(1) << 40;
+  huge_layer.replace(3 * sizeof(size_t), sizeof(rows),
+                     reinterpret_cast<char*>(&rows), sizeof(rows));
+  // the file ends with the name of the loss
+  std::string unknown_loss = bytes;
+  unknown_loss.replace(bytes.size() - 6, 6, "sqware");
+  std::string truncated = bytes.substr(0, bytes.size() / 2);
+
+  mlp::MultilayerPerceptron model(
+      {5, 3}, {mlp::ActivationFunctionsList().GetByName("relu")},
+      mlp::LossFunctionsList().GetByName("square"));
+  mlp::Vector input = mlp::Vector::Random(5);
+  mlp::Vector expected = model.Calculate(input);
+
+  mlp::ModelRegistry registry;
+  for (const std::string& corrupt : {huge_layer, unknown_loss, truncated}) {
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out << corrupt;
+    }
+    EXPECT_EQ(registry.Get(path), nullptr);
+
+    // and leaves the model as it was
+    EXPECT_FALSE(model.LoadModel(path, {}, {}));
+    EXPECT_EQ(model.Calculate(input), expected);
+  }
+  EXPECT_EQ(registry.GetStats().num_of_models, 0u);
+}
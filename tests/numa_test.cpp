@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+#include <mlp/replicated_model.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+TEST(NumaTest, ParsesCpuLists) {
+  EXPECT_EQ(mlp::ParseCpuList("0-3,8,10-11"),
+            std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(mlp::ParseCpuList("5"), std::vector<int>({5}));
+  EXPECT_TRUE(mlp::ParseCpuList("").empty());
+}
+
+TEST(NumaTest, WorkersSpreadOverNodes) {
+  mlp::NumaTopology topology({{0, 1, 2, 3}, {4, 5, 6, 7}});
+  EXPECT_EQ(topology.GetNode(5), 1u);
+  EXPECT_EQ(topology.GetNode(100), 0u);
+
+  EXPECT_EQ(topology.GetWorkerNode(0), 0u);
+  EXPECT_EQ(topology.GetWorkerNode(1), 1u);
+  EXPECT_EQ(topology.GetWorkerNode(2), 0u);
+
+  EXPECT_EQ(topology.GetWorkerCpus(0, mlp::ThreadAffinity::kCore),
+            std::vector<int>({0}));
+  EXPECT_EQ(topology.GetWorkerCpus(3, mlp::ThreadAffinity::kCore),
+            std::vector<int>({5}));
+  EXPECT_EQ(topology.GetWorkerCpus(3, mlp::ThreadAffinity::kNode),
+            std::vector<int>({4, 5, 6, 7}));
+  EXPECT_TRUE(topology.GetWorkerCpus(3, mlp::ThreadAffinity::kNone).empty());
+}
+
+TEST(NumaTest, PinnedTasksRunOnTheirWorker) {
+  const mlp::NumaTopology& topology = mlp::NumaTopology::Get();
+  ASSERT_GE(topology.GetNumOfNodes(), 1u);
+
+  mlp::ThreadPool pool(3, mlp::ThreadAffinity::kCore);
+  std::vector<std::thread::id> ids(6);
+  std::vector<int> cpus(6, -1);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    pool.SubmitTo(i % 3, [&, i] {
+      ids[i] = std::this_thread::get_id();
+#if defined(__linux__)
+      cpus[i] = sched_getcpu();
+#endif
+    });
+  }
+  pool.Wait();
+
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(ids[i], ids[i + 3]);
+    EXPECT_NE(ids[i], ids[(i + 1) % 3]);
+#if defined(__linux__)
+    EXPECT_EQ(std::vector<int>({cpus[i]}),
+              topology.GetWorkerCpus(i, mlp::ThreadAffinity::kCore));
+#endif
+  }
+}
+
+TEST(NumaTest, PlacedDataTrainsTheSame) {
+  mlp::ActivationFunctionsList act_list;
+  mlp::DataSet input, output;
+  std::srand(8);
+  for (size_t i = 0; i < 40; ++i) {
+    mlp::Vector x = mlp::Vector::Random(4);
+    input.emplace_back(x.data(), x.data() + x.size());
+    output.emplace_back(2, 0.0);
+    output.back()[i % 2] = 1.0;
+  }
+
+  std::srand(1);
+  mlp::MultilayerPerceptron model(
+      {4, 6, 2}, {act_list.GetByName("relu"), act_list.GetByName("softmax")},
+      mlp::LossFunctionsList().GetByName("square"));
+  model.SetBatchSize(4);
+  mlp::MultilayerPerceptron placed = model;
+
+  // a single worker is deterministic
+  mlp::AsyncTrainingOptions options;
+  options.local_batch_size = 4;
+  model.TrainAsync(3, input, output, options);
+
+  mlp::ThreadPool pool(2, mlp::ThreadAffinity::kNode);
+  options.pool = &pool;
+  options.place_data_on_workers = true;
+  placed.TrainAsync(3, input, output, options);
+
+  EXPECT_EQ(placed.GetParameterSpan(), model.GetParameterSpan());
+}
+
+TEST(NumaTest, ReplicasCalculateLikeTheModel) {
+  mlp::ActivationFunctionsList act_list;
+  std::srand(6);
+  mlp::MultilayerPerceptron model(
+      {5, 7, 3}, {act_list.GetByName("tanh"), act_list.GetByName("softmax")},
+      mlp::LossFunctionsList().GetByName("square"));
+
+  mlp::ThreadPool pool(4, mlp::ThreadAffinity::kNode);
+  mlp::ReplicatedModel replicas(model, pool);
+  EXPECT_EQ(replicas.GetNumOfReplicas(),
+            std::min<size_t>(4, mlp::NumaTopology::Get().GetNumOfNodes()));
+
+  std::vector<mlp::Vector> inputs;
+  for (int i = 0; i < 50; ++i) {
+    inputs.push_back(mlp::Vector::Random(5));
+  }
+  std::vector<mlp::Vector> outputs = replicas.Calculate(inputs);
+
+  ASSERT_EQ(outputs.size(), inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    EXPECT_EQ(outputs[i], model.Calculate(inputs[i]));
+  }
+  EXPECT_EQ(replicas.GetLocal().Calculate(inputs[0]), outputs[0]);
+  EXPECT_EQ(replicas.GetLocal().GetMemoryUsage() * 2,
+            model.GetMemoryUsage());
+}
+
+TEST(NumaTest, PoolRethrowsTaskExceptions) {
+  mlp::ThreadPool pool(2);
+  size_t done = 0;
+  pool.Submit([] { throw std::runtime_error("task"); });
+  pool.SubmitTo(1, [&done] { ++done; });
+  EXPECT_THROW(pool.Wait(), std::runtime_error);
+  EXPECT_EQ(done, 1u);
+
+  // the workers survive and the exception is reported once
+  pool.SubmitTo(0, [&done] { ++done; });
+  pool.Wait();
+  EXPECT_EQ(done, 2u);
+
+  mlp::TaskGroup group(pool);
+  group.SubmitTo(1, [] { throw std::logic_error("group task"); });
+  EXPECT_THROW(group.Wait(), std::logic_error);
+  pool.Wait();
+}
+
+TEST(NumaTest, GroupsWaitOnlyForTheirTasks) {
+  mlp::ThreadPool pool(2);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+
+  mlp::TaskGroup blocked(pool);
+  blocked.SubmitTo(0, [released] { released.wait(); });
+
+  // returns while the other group's task still holds worker 0
+  bool done = false;
+  mlp::TaskGroup group(pool);
+  group.SubmitTo(1, [&done] { done = true; });
+  group.Wait();
+  EXPECT_TRUE(done);
+
+  release.set_value();
+  blocked.Wait();
+}
+
+TEST(NumaTest, ReplicasCalculateFromAWorker) {
+  mlp::ActivationFunctionsList act_list;
+  std::srand(7);
+  mlp::MultilayerPerceptron model(
+      {5, 7, 3}, {act_list.GetByName("tanh"), act_list.GetByName("softmax")},
+      mlp::LossFunctionsList().GetByName("square"));
+
+  mlp::ThreadPool pool(2);
+  mlp::ReplicatedModel replicas(model, pool);
+  std::vector<mlp::Vector> inputs(10, mlp::Vector::Random(5));
+
+  // every worker waits for tasks pinned to itself, and both calls share
+  // the pool
+  std::vector<std::vector<mlp::Vector>> outputs(2);
+  for (size_t w = 0; w < 2; ++w) {
+    pool.SubmitTo(w, [&, w] { outputs[w] = replicas.Calculate(inputs); });
+  }
+  pool.Wait();
+
+  for (const auto& worker_outputs : outputs) {
+    ASSERT_EQ(worker_outputs.size(), inputs.size());
+    EXPECT_EQ(worker_outputs[0], model.Calculate(inputs[0]));
+  }
+}
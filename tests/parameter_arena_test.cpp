@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include "test_util.h"
+
+namespace {
+
+mlp::MultilayerPerceptron MakeModel() {
+  mlp::MultilayerPerceptron model = test_util::MakeModel(
+      {7, 5, 3, 2}, 11, {"relu", "sigmoid", "softmax"});
+  model.SetBatchSize(4);
+  return model;
+}
+
+void TrainOnRandomSamples(mlp::MultilayerPerceptron& model, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    mlp::Vector output = mlp::Vector::Zero(2);
+    output[static_cast<ssize_t>(i % 2)] = 1.0;
+    model.TrainOnOneSample(mlp::Vector::Random(7), output);
+  }
+}
+
+}  // namespace
+
+TEST(ParameterArenaTest, LayersAreAlignedViews) {
+  std::srand(2);
+  std::vector<mlp::LinearLayer> layers = {mlp::LinearLayer(7, 5),
+                                          mlp::LinearLayer(5, 3)};
+  mlp::ParameterArena arena(layers);
+
+  ASSERT_EQ(arena.size(), 2u);
+  EXPECT_EQ(arena.GetSize(), mlp::GetLayerBlockSize(7, 5) +
+                                 mlp::GetLayerBlockSize(5, 3));
+  for (size_t i = 0; i < arena.size(); ++i) {
+    EXPECT_EQ(arena[i].GetARef(), layers[i].GetARef());
+    EXPECT_EQ(arena[i].GetbRef(), layers[i].GetbRef());
+    EXPECT_EQ(arena[i].GetARef().data(),
+              arena.GetData() + arena.GetOffsets()[i]);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(arena[i].GetbRef().data()) %
+                  mlp::kCacheLineSize,
+              0u);
+  }
+
+  // copies are deep
+  mlp::ParameterArena copy = arena;
+  copy[0].GetARef().setZero();
+  EXPECT_EQ(arena[0].GetARef(), layers[0].GetARef());
+  EXPECT_EQ(copy[0].GetARef().data(), copy.GetData());
+}
+
+TEST(ParameterArenaTest, UpdateIsOnePassOverFlatSpans) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  TrainOnRandomSamples(model, 4);
+
+  mlp::Vector parameters = model.GetParameterSpan();
+  mlp::Vector gradients = model.GetGradientSpan();
+  EXPECT_EQ(model.GetGradientOffset(), 0u);
+  EXPECT_GT(gradients.cwiseAbs().maxCoeff(), 0.0);
+
+  model.UpdateParameters();
+
+  mlp::Vector expected = parameters - gradients / 4.0;
+  EXPECT_LE((model.GetParameterSpan() - expected).cwiseAbs().maxCoeff(),
+            1e-15);
+  EXPECT_EQ(model.GetGradientSpan().cwiseAbs().maxCoeff(), 0.0);
+}
+
+TEST(ParameterArenaTest, CopiedModelIsIndependent) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::MultilayerPerceptron copy = model;
+  mlp::Vector input = mlp::Vector::Random(7);
+  mlp::Vector result = model.Calculate(input);
+
+  EXPECT_NE(copy.GetParameterSpan().data(), model.GetParameterSpan().data());
+  EXPECT_EQ(copy.Calculate(input), result);
+
+  model.GetParameterSpan().setZero();
+  EXPECT_EQ(copy.Calculate(input), result);
+
+  // a moved model keeps its views valid
+  mlp::MultilayerPerceptron moved = std::move(copy);
+  EXPECT_EQ(moved.Calculate(input), result);
+}
+
+TEST(ParameterArenaTest, FrozenLayersKeepWeights) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  model.FreezeLayer(0);
+  model.FreezeLayer(2);
+
+  // only the frozen prefix gets no gradients
+  size_t prefix_size = mlp::GetLayerBlockSize(7, 5);
+  EXPECT_EQ(model.GetGradientOffset(), prefix_size);
+  EXPECT_EQ(static_cast<size_t>(model.GetGradientSpan().size()),
+            static_cast<size_t>(model.GetParameterSpan().size()) -
+                prefix_size);
+
+  mlp::Vector before = model.GetParameterSpan();
+  TrainOnRandomSamples(model, 8);
+  model.UpdateParameters();
+  mlp::Vector after = model.GetParameterSpan();
+
+  size_t middle_size = mlp::GetLayerBlockSize(5, 3);
+  ssize_t last = static_cast<ssize_t>(prefix_size + middle_size);
+  EXPECT_EQ(after.head(static_cast<ssize_t>(prefix_size)),
+            before.head(static_cast<ssize_t>(prefix_size)));
+  EXPECT_EQ(after.tail(after.size() - last), before.tail(before.size() - last));
+  EXPECT_NE(after.segment(static_cast<ssize_t>(prefix_size),
+                          static_cast<ssize_t>(middle_size)),
+            before.segment(static_cast<ssize_t>(prefix_size),
+                           static_cast<ssize_t>(middle_size)));
+}
+
+TEST(ParameterArenaTest, CheckpointRoundTrip) {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mlp-checkpoint-" + std::to_string(getpid())))
+                         .string();
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  TrainOnRandomSamples(model, 4);
+  model.UpdateParameters();
+  model.SaveCheckpoint(path);
+
+  mlp::MultilayerPerceptron restored = MakeModel();
+  ASSERT_TRUE(restored.LoadCheckpoint(path));
+  EXPECT_EQ(restored.GetParameterSpan(), model.GetParameterSpan());
+
+  mlp::ActivationFunctionsList act_list;
+  mlp::LossFunctionsList loss_list;
+  mlp::MultilayerPerceptron other_shape({7, 2}, {act_list.GetByName("relu")},
+                                        loss_list.GetByName("square"));
+  EXPECT_FALSE(other_shape.LoadCheckpoint(path));
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include "test_util.h"
+
+namespace {
+
+mlp::MultilayerPerceptron MakeModel() {
+  mlp::MultilayerPerceptron model = test_util::MakeModel({6, 5, 3}, 12);
+  model.SetBatchSize(4);
+  return model;
+}
+
+// pixels of 6 features, a third of them zero
+mlp::FeatureBatch<uint8_t> MakePixels(size_t size) {
+  mlp::FeatureBatch<uint8_t> batch;
+  batch.num_of_features = 6;
+  for (size_t i = 0; i < size * 6; ++i) {
+    batch.values.push_back(i % 3 == 0 ? 0 : static_cast<uint8_t>(i * 37));
+  }
+  return batch;
+}
+
+mlp::Vector Normalize(const uint8_t* raw, double scale) {
+  mlp::Vector x(6);
+  for (int j = 0; j < 6; ++j) {
+    x[j] = scale * static_cast<double>(raw[j]);
+  }
+  return x;
+}
+
+}  // namespace
+
+TEST(RawInputTest, FoldedLayerMatchesNormalizedInput) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  model.SetInputNormalization(mlp::Vector::Constant(6, 1.0 / 255.0),
+                              mlp::Vector::Zero(6));
+  EXPECT_TRUE(model.HasInputNormalization());
+
+  mlp::FeatureBatch<uint8_t> pixels = MakePixels(10);
+  ASSERT_EQ(pixels.size(), 10u);
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    mlp::Vector expected = model.Calculate(Normalize(pixels[i], 1.0 / 255.0));
+    EXPECT_LE((model.Calculate(pixels[i]) - expected).cwiseAbs().maxCoeff(),
+              1e-12);
+  }
+
+  // signed features with per-feature offsets
+  mlp::Vector scale(6), offset(6);
+  scale << 0.5, 0.01, 2.0, 1.0, 0.1, 0.25;
+  offset << -1.0, 0.5, 0.0, 3.0, -0.2, 0.0;
+  model.SetInputNormalization(scale, offset);
+
+  const int16_t raw[6] = {-300, 12, 0, 7, 1000, -1};
+  mlp::Vector x(6);
+  for (int j = 0; j < 6; ++j) {
+    x[j] = scale[j] * raw[j] + offset[j];
+  }
+  EXPECT_LE((model.Calculate(raw) - model.Calculate(x)).cwiseAbs().maxCoeff(),
+            1e-12);
+}
+
+TEST(RawInputTest, TrainingNormalizesOnTheFly) {
+  mlp::FeatureBatch<uint8_t> pixels = MakePixels(20);
+  mlp::DataSet input, output;
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    mlp::Vector x = Normalize(pixels[i], 1.0 / 255.0);
+    input.emplace_back(x.data(), x.data() + x.size());
+    output.emplace_back(3, 0.0);
+    output.back()[i % 3] = 1.0;
+  }
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  model.SetInputNormalization(mlp::Vector::Constant(6, 1.0 / 255.0),
+                              mlp::Vector::Zero(6));
+  mlp::MultilayerPerceptron expected = model;
+
+  model.Train(3, pixels, output);
+  expected.Train(3, input, output);
+
+  // the folded layer follows the updates
+  EXPECT_LE((model.Calculate(pixels[1]) -
+             expected.Calculate(mlp::to_Vector(input[1])))
+                .cwiseAbs()
+                .maxCoeff(),
+            1e-12);
+  EXPECT_EQ(model.GetParameterSpan(), expected.GetParameterSpan());
+}
+
+TEST(RawInputTest, StaleFoldUsesTheNormalizedInput) {
+  mlp::FeatureBatch<uint8_t> pixels = MakePixels(8);
+  mlp::DataSet output(8, std::vector<double>{0.0, 1.0, 0.0});
+  mlp::MultilayerPerceptron model = MakeModel();
+  model.SetInputNormalization(mlp::Vector::Constant(6, 1.0 / 255.0),
+                              mlp::Vector::Zero(6));
+
+  auto error = [&pixels](const mlp::MultilayerPerceptron& m) {
+    return (m.Calculate(pixels[1]) -
+            m.Calculate(Normalize(pixels[1], 1.0 / 255.0)))
+        .cwiseAbs()
+        .maxCoeff();
+  };
+
+  // updates outside of Train don't refold
+  model.TrainOnOneSample(pixels[0], mlp::to_Vector(output[0]));
+  model.UpdateParameters();
+  EXPECT_LE(error(model), 1e-12);
+
+  model.Train(1, pixels, output);
+  EXPECT_LE(error(model), 1e-12);
+
+  model.GetParameterSpan() *= 0.5;
+  EXPECT_LE(error(model), 1e-12);
+  EXPECT_LE(error(model.CopyWithoutGradients()), 1e-12);
+
+  // the callback may serve the model, so it gets a folded one
+  size_t calls = 0;
+  model.SetUpdateCallback([&](const mlp::MultilayerPerceptron& m) {
+    EXPECT_LE(error(m), 1e-12);
+    ++calls;
+  });
+  model.TrainOnOneSample(pixels[2], mlp::to_Vector(output[2]));
+  model.UpdateParameters();
+  EXPECT_EQ(calls, 1u);
+}
+
+TEST(RawInputTest, NormalizationIsSavedWithTheModel) {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mlp-raw-input-" + std::to_string(getpid())))
+                         .string();
+
+  mlp::MultilayerPerceptron model = MakeModel();
+  model.SetInputNormalization(mlp::Vector::Constant(6, 0.5),
+                              mlp::Vector::Constant(6, -1.0));
+  model.SaveModel(path);
+
+  mlp::MultilayerPerceptron loaded;
+  loaded.LoadModel(path, {}, {});
+  ASSERT_TRUE(loaded.HasInputNormalization());
+  EXPECT_EQ(loaded.GetInputScale(), model.GetInputScale());
+  EXPECT_EQ(loaded.GetInputOffset(), model.GetInputOffset());
+
+  mlp::FeatureBatch<uint8_t> pixels = MakePixels(1);
+  EXPECT_EQ(loaded.Calculate(pixels[0]), model.Calculate(pixels[0]));
+
+  // files without the trailer load as before
+  model.ClearInputNormalization();
+  model.SaveModel(path);
+  loaded.LoadModel(path, {}, {});
+  EXPECT_FALSE(loaded.HasInputNormalization());
+  mlp::Vector x = mlp::Vector::Random(6);
+  EXPECT_EQ(loaded.Calculate(x), model.Calculate(x));
+
+  std::filesystem::remove(path);
+}
+
+TEST(RawInputTest, RawFeaturesNeedANormalization) {
+  mlp::MultilayerPerceptron model = MakeModel();
+  mlp::FeatureBatch<uint8_t> pixels = MakePixels(4);
+  mlp::DataSet output(4, std::vector<double>{1.0, 0.0, 0.0});
+  int16_t features[6] = {1, -2, 0, 4, 0, 6};
+
+  EXPECT_THROW(model.Calculate(pixels[0]), std::logic_error);
+  EXPECT_THROW(model.Calculate(features), std::logic_error);
+  EXPECT_THROW(model.TrainOnOneSample(pixels[0], mlp::Vector::Zero(3)),
+               std::logic_error);
+  EXPECT_THROW(model.Train(1, pixels, output), std::logic_error);
+
+  model.SetInputNormalization(mlp::Vector::Constant(6, 1.0 / 255.0),
+                              mlp::Vector::Zero(6));
+  model.ClearInputNormalization();
+  EXPECT_THROW(model.Calculate(pixels[0]), std::logic_error);
+}
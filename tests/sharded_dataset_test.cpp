@@ -0,0 +1,306 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+class ShardedDataSetTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    _directory = std::filesystem::temp_directory_path() /
+                 ("mlp-sharded-test-" + std::to_string(getpid()));
+    std::filesystem::remove_all(_directory);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(_directory); }
+
+  std::string Path(const std::string& name) const {
+    return (_directory / name).string();
+  }
+
+  std::filesystem::path _directory;
+};
+
+// features in [0, 1] after a unique key of the sample, 3 classes
+void MakeKeyedDataSet(size_t size, mlp::DataSet& input, mlp::DataSet& output) {
+  test_util::MakeDataSet(size, 5, 3, 3, input, output);
+  for (size_t i = 0; i < size; ++i) {
+    for (auto& v : input[i]) {
+      v = (v + 1.0) / 2.0;
+    }
+    input[i][0] = static_cast<double>(i);
+  }
+}
+
+// every sample of the epoch keyed by its input[0]
+std::map<double, std::pair<mlp::Vector, mlp::Vector>> ReadEpoch(
+    mlp::SampleSource& source) {
+  std::map<double, std::pair<mlp::Vector, mlp::Vector>> samples;
+  mlp::Vector input, output;
+  source.Reset();
+  while (source.Next(input, output)) {
+    EXPECT_EQ(samples.count(input[0]), 0u);
+    samples[input[0]] = {input, output};
+  }
+  return samples;
+}
+
+void WriteBigEndianInt32(std::ofstream& out, int32_t x) {
+  uint8_t bytes[4] = {uint8_t(x >> 24), uint8_t(x >> 16), uint8_t(x >> 8),
+                      uint8_t(x)};
+  out.write(reinterpret_cast<char*>(bytes), sizeof(bytes));
+}
+
+}  // namespace
+
+TEST_F(ShardedDataSetTest, EncodingsRoundTrip) {
+  mlp::DataSet input, output;
+  MakeKeyedDataSet(250, input, output);
+
+  struct Case {
+    mlp::FeatureEncoding encoding;
+    double tolerance;
+  };
+  for (const Case& c : {Case{mlp::FeatureEncoding::kFloat64, 0.0},
+                        Case{mlp::FeatureEncoding::kFloat32, 1e-7},
+                        Case{mlp::FeatureEncoding::kFloat16, 1e-3}}) {
+    SCOPED_TRACE(static_cast<int>(c.encoding));
+
+    mlp::ShardedDataSetOptions options;
+    options.input_encoding = c.encoding;
+    options.output_encoding = mlp::OutputEncoding::kClassIndex;
+    options.records_per_shard = 16;
+    std::string directory = Path(std::to_string(static_cast<int>(c.encoding)));
+    ASSERT_TRUE(mlp::WriteShardedDataSet(directory, input, output, options));
+
+    mlp::ShardedDataSetReader reader(directory);
+    ASSERT_TRUE(reader.IsOk());
+    EXPECT_EQ(reader.GetNumOfSamples(), input.size());
+    EXPECT_EQ(reader.GetNumOfShards(), 16u);
+
+    auto samples = ReadEpoch(reader);
+    ASSERT_EQ(samples.size(), input.size());
+    for (size_t i = 0; i < input.size(); ++i) {
+      const auto& sample = samples[static_cast<double>(i)];
+      EXPECT_LE((sample.first - mlp::to_Vector(input[i])).cwiseAbs().maxCoeff(),
+                c.tolerance);
+      EXPECT_EQ(sample.second, mlp::to_Vector(output[i]));
+    }
+  }
+}
+
+TEST_F(ShardedDataSetTest, UInt8AndFloat16Quantization) {
+  mlp::DataSet input, output;
+  MakeKeyedDataSet(100, input, output);
+  for (auto& x : input) {
+    x[0] = 0.0;
+  }
+
+  for (auto encoding :
+       {mlp::FeatureEncoding::kUInt8, mlp::FeatureEncoding::kFloat16}) {
+    mlp::ShardedDataSetOptions options;
+    options.input_encoding = encoding;
+    std::string directory = Path("q" + std::to_string(int(encoding)));
+    ASSERT_TRUE(mlp::WriteShardedDataSet(directory, input, output, options));
+
+    mlp::ShardedReadOptions read_options;
+    read_options.shuffle = false;
+    mlp::ShardedDataSetReader reader(directory, read_options);
+    ASSERT_TRUE(reader.IsOk());
+
+    double tolerance = encoding == mlp::FeatureEncoding::kUInt8
+                           ? 0.5 / 255.0 + 1e-12
+                           : 1.0 / 2048.0;
+    mlp::Vector x, y;
+    for (size_t i = 0; i < input.size(); ++i) {
+      ASSERT_TRUE(reader.Next(x, y));
+      EXPECT_LE((x - mlp::to_Vector(input[i])).cwiseAbs().maxCoeff(),
+                tolerance);
+      EXPECT_EQ(y, mlp::to_Vector(output[i]));
+    }
+    EXPECT_FALSE(reader.Next(x, y));
+  }
+}
+
+TEST_F(ShardedDataSetTest, ShufflesAcrossShards) {
+  mlp::DataSet input, output;
+  MakeKeyedDataSet(400, input, output);
+
+  mlp::ShardedDataSetOptions options;
+  options.input_encoding = mlp::FeatureEncoding::kFloat64;
+  options.records_per_shard = 50;
+  ASSERT_TRUE(mlp::WriteShardedDataSet(Path("s"), input, output, options));
+
+  mlp::ShardedDataSetReader reader(Path("s"));
+  std::vector<double> order;
+  mlp::Vector x, y;
+  while (reader.Next(x, y)) {
+    order.push_back(x[0]);
+  }
+  ASSERT_EQ(order.size(), input.size());
+
+  // the first window has 2 shards and its records are interleaved
+  std::set<size_t> first_shards;
+  for (size_t i = 0; i < 100; ++i) {
+    first_shards.insert(static_cast<size_t>(order[i]) / 50);
+  }
+  EXPECT_EQ(first_shards.size(), 2u);
+  EXPECT_FALSE(std::is_sorted(order.begin(), order.begin() + 50));
+
+  // the next epoch has another order
+  reader.Reset();
+  std::vector<double> next_order;
+  while (reader.Next(x, y)) {
+    next_order.push_back(x[0]);
+  }
+  EXPECT_NE(order, next_order);
+}
+
+TEST_F(ShardedDataSetTest, ConvertsIdx) {
+  std::filesystem::create_directories(_directory);
+  const int32_t num_of_images = 30;
+  {
+    std::ofstream images(Path("images"), std::ios::binary);
+    std::ofstream labels(Path("labels"), std::ios::binary);
+    WriteBigEndianInt32(images, mlp::IDX_MAGIC_NUMBER_IMAGES);
+    WriteBigEndianInt32(images, num_of_images);
+    WriteBigEndianInt32(images, 2);
+    WriteBigEndianInt32(images, 3);
+    WriteBigEndianInt32(labels, mlp::IDX_MAGIC_NUMBER_LABELS);
+    WriteBigEndianInt32(labels, num_of_images);
+    for (int32_t i = 0; i < num_of_images; ++i) {
+      for (int j = 0; j < 6; ++j) {
+        images.put(static_cast<char>((i * 7 + j * 31) % 256));
+      }
+      labels.put(static_cast<char>(i % 10));
+    }
+  }
+
+  mlp::ShardedDataSetOptions options;
+  options.input_encoding = mlp::FeatureEncoding::kUInt8;
+  options.output_encoding = mlp::OutputEncoding::kClassIndex;
+  options.records_per_shard = 7;
+  ASSERT_TRUE(mlp::ConvertIdxToShardedDataSet(
+      Path("images"), Path("labels"), 10, Path("idx"), options));
+
+  mlp::DataSet images = mlp::ReadIdxImages(Path("images"));
+  mlp::DataSet labels =
+      mlp::LabelsToDataSet(mlp::ReadIdxLabels(Path("labels")), 10);
+
+  mlp::ShardedReadOptions read_options;
+  read_options.shuffle = false;
+  mlp::ShardedDataSetReader reader(Path("idx"), read_options);
+  ASSERT_EQ(reader.GetNumOfSamples(), images.size());
+  EXPECT_EQ(reader.GetInputSize(), 6);
+  EXPECT_EQ(reader.GetOutputSize(), 10);
+
+  // pixels are stored as they are, so decoding is exact up to rounding
+  mlp::Vector x, y;
+  for (size_t i = 0; i < images.size(); ++i) {
+    ASSERT_TRUE(reader.Next(x, y));
+    EXPECT_LE((x - mlp::to_Vector(images[i])).cwiseAbs().maxCoeff(), 1e-15);
+    EXPECT_EQ(y, mlp::to_Vector(labels[i]));
+  }
+
+  EXPECT_FALSE(mlp::ShardedDataSetReader(Path("missing")).IsOk());
+}
+
+TEST_F(ShardedDataSetTest, RejectsCorruptIdxCounts) {
+  std::filesystem::create_directories(_directory);
+  {
+    // a header claiming 2^31 - 1 images of 2^31 - 1 by 2^31 - 1 pixels
+    std::ofstream images(Path("images"), std::ios::binary);
+    WriteBigEndianInt32(images, mlp::IDX_MAGIC_NUMBER_IMAGES);
+    for (int i = 0; i < 3; ++i) {
+      WriteBigEndianInt32(images, INT32_MAX);
+    }
+    images.put(0);
+    std::ofstream labels(Path("labels"), std::ios::binary);
+    WriteBigEndianInt32(labels, mlp::IDX_MAGIC_NUMBER_LABELS);
+    WriteBigEndianInt32(labels, INT32_MAX);
+    labels.put(0);
+    // 2 images of 2 by 2 pixels, one of them truncated
+    std::ofstream truncated(Path("truncated"), std::ios::binary);
+    WriteBigEndianInt32(truncated, mlp::IDX_MAGIC_NUMBER_IMAGES);
+    WriteBigEndianInt32(truncated, 2);
+    WriteBigEndianInt32(truncated, 2);
+    WriteBigEndianInt32(truncated, 2);
+    for (int i = 0; i < 6; ++i) {
+      truncated.put(static_cast<char>(i));
+    }
+  }
+
+  EXPECT_EQ(mlp::ReadIdxImagesRaw(Path("images")).size(), 0u);
+  EXPECT_TRUE(mlp::ReadIdxLabels(Path("labels")).empty());
+  EXPECT_EQ(mlp::ReadIdxImagesRaw(Path("truncated")).size(), 0u);
+}
+
+TEST_F(ShardedDataSetTest, RejectsCorruptShardCount) {
+  mlp::DataSet input, output;
+  MakeKeyedDataSet(20, input, output);
+  mlp::ShardedDataSetOptions options;
+  options.records_per_shard = 8;
+  ASSERT_TRUE(mlp::WriteShardedDataSet(Path("data"), input, output, options));
+  ASSERT_TRUE(mlp::ShardedDataSetReader(Path("data")).IsOk());
+
+  // the shard count is followed by the size of every shard
+  std::fstream index(Path("data/index"),
+                     std::ios::binary | std::ios::in | std::ios::out);
+  index.seekp(-static_cast<std::streamoff>(4 * sizeof(uint64_t)),
+              std::ios::end);
+  uint64_t num_of_shards = uint64_t(1) << 60;
+  index.write(reinterpret_cast<char*>(&num_of_shards), sizeof(num_of_shards));
+  index.close();
+
+  EXPECT_FALSE(mlp::ShardedDataSetReader(Path("data")).IsOk());
+}
+
+TEST_F(ShardedDataSetTest, TrainsFromSource) {
+  mlp::DataSet input, output;
+  MakeKeyedDataSet(600, input, output);
+  // make the class learnable from the features
+  for (size_t i = 0; i < input.size(); ++i) {
+    input[i][0] = 0.0;
+    input[i][1 + i % 3] += 2.0;
+  }
+
+  mlp::ShardedDataSetOptions options;
+  options.input_encoding = mlp::FeatureEncoding::kFloat16;
+  options.output_encoding = mlp::OutputEncoding::kClassIndex;
+  options.records_per_shard = 64;
+  ASSERT_TRUE(mlp::WriteShardedDataSet(Path("t"), input, output, options));
+
+  mlp::ActivationFunctionsList act_list;
+  mlp::LossFunctionsList loss_list;
+  std::srand(5);
+  mlp::MultilayerPerceptron model(
+      {5, 8, 3}, {act_list.GetByName("sigmoid"), act_list.GetByName("softmax")},
+      loss_list.GetByName("square"));
+  model.SetBatchSize(10);
+
+  mlp::ShardedDataSetReader reader(Path("t"));
+  model.Train(10, reader);
+
+  size_t correct_answers = 0;
+  for (size_t i = 0; i < input.size(); ++i) {
+    Eigen::Index chosen;
+    model.Calculate(mlp::to_Vector(input[i])).maxCoeff(&chosen);
+    if (static_cast<size_t>(chosen) == i % 3) {
+      ++correct_answers;
+    }
+  }
+  EXPECT_GT(correct_answers, input.size() * 9 / 10);
+}
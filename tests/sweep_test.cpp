@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <mlp/mlp.h>
+#include <mlp/sweep.h>
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <set>
+
+#include "test_util.h"
+
+namespace {
+
+struct DataSets {
+  std::shared_ptr<mlp::DataSet> input = std::make_shared<mlp::DataSet>();
+  std::shared_ptr<mlp::DataSet> output = std::make_shared<mlp::DataSet>();
+};
+
+// two classes split by the sign of the first feature
+DataSets MakeDataSets(unsigned seed) {
+  DataSets data;
+  test_util::MakeSeparableDataSet(60, 3, seed, *data.input, *data.output);
+  return data;
+}
+
+// an activation of a diverged trial
+mlp::ActivationFunctionsList WithNanActivation() {
+  mlp::ActivationFunctionsList act_list;
+  act_list.InsertFunction(
+      [](const mlp::Vector& x) {
+        return mlp::Vector::Constant(x.size(),
+                                     std::numeric_limits<double>::quiet_NaN());
+      },
+      [](const mlp::Vector& x) {
+        return mlp::Matrix::Identity(x.size(), x.size());
+      },
+      "nan");
+  return act_list;
+}
+
+mlp::SweepSpec MakeSpec() {
+  mlp::SweepSpec spec;
+  spec.hidden_layers = {{4}, {8}};
+  spec.activations = {"tanh", "nan"};
+  spec.batch_sizes = {4, 8};
+  spec.num_of_iterations = 3;
+  spec.num_of_threads = 2;
+  spec.prune = false;
+  return spec;
+}
+
+}  // namespace
+
+TEST(SweepTest, GridRunsEveryTrialOnce) {
+  DataSets train = MakeDataSets(1), validation = MakeDataSets(2);
+  mlp::SweepRunner runner(train.input, train.output, validation.input,
+                          validation.output, WithNanActivation());
+
+  std::vector<mlp::TrialResult> results = runner.Run(MakeSpec());
+  ASSERT_EQ(results.size(), 8u);
+
+  std::set<size_t> ids;
+  for (const auto& result : results) {
+    ids.insert(result.id);
+    EXPECT_EQ(result.num_of_iterations, 3u);
+  }
+  EXPECT_EQ(ids.size(), results.size());
+}
+
+TEST(SweepTest, BestModelIsTheFirstResult) {
+  DataSets train = MakeDataSets(3), validation = MakeDataSets(4);
+  mlp::SweepRunner runner(train.input, train.output, validation.input,
+                          validation.output, WithNanActivation());
+
+  mlp::SweepSpec spec = MakeSpec();
+  spec.prune = true;
+  spec.min_trials_to_prune = 2;
+  std::vector<mlp::TrialResult> results = runner.Run(spec);
+
+  // the diverged trials rank last
+  const mlp::TrialResult& best = results.front();
+  EXPECT_EQ(best.config.activation, "tanh");
+  EXPECT_FALSE(best.pruned);
+  EXPECT_FALSE(std::isnan(best.validation_loss));
+  for (size_t i = 0; i + 1 < results.size(); ++i) {
+    EXPECT_LE(results[i].pruned, results[i + 1].pruned);
+  }
+  EXPECT_TRUE(std::isnan(results.back().validation_loss));
+
+  mlp::MultilayerPerceptron model = runner.GetBestModel();
+  ASSERT_EQ(model.GetNumOfLayers(), 2u);
+  EXPECT_EQ(model.GetLinearLayer(0).GetOutputSize(),
+            best.config.hidden_layers[0]);
+  EXPECT_EQ(model.GetBatchSize(), best.config.batch_size);
+}
+
+TEST(SweepTest, EveryTrialDiverged) {
+  DataSets train = MakeDataSets(5), validation = MakeDataSets(6);
+  mlp::SweepRunner runner(train.input, train.output, validation.input,
+                          validation.output, WithNanActivation());
+
+  mlp::SweepSpec spec = MakeSpec();
+  runner.Run(spec);
+
+  spec.activations = {"nan"};
+  std::vector<mlp::TrialResult> results = runner.Run(spec);
+  ASSERT_EQ(results.size(), 4u);
+  for (size_t i = 0; i + 1 < results.size(); ++i) {
+    EXPECT_LT(results[i].id, results[i + 1].id);
+  }
+
+  // the model of this run, not of the previous one
+  const mlp::MultilayerPerceptron& model = runner.GetBestModel();
+  ASSERT_EQ(model.GetNumOfLayers(), 2u);
+  EXPECT_EQ(model.GetNonLinearLayer(0).GetActivatioFunc().GetName(), "nan");
+}
+
+TEST(SweepTest, PrunerStopsClearlyWorseTrials) {
+  mlp::MedianPruner pruner(true, 2);
+  EXPECT_FALSE(pruner.Report(0, 1.0));
+  EXPECT_FALSE(pruner.Report(0, 1.2));
+  EXPECT_TRUE(pruner.Report(0, 5.0));
+  EXPECT_FALSE(pruner.Report(0, 0.5));
+  EXPECT_TRUE(pruner.Report(0, std::numeric_limits<double>::quiet_NaN()));
+
+  // every epoch has its own median
+  EXPECT_FALSE(pruner.Report(1, 5.0));
+
+  mlp::MedianPruner disabled(false, 0);
+  EXPECT_FALSE(disabled.Report(0, 1.0));
+  EXPECT_FALSE(disabled.Report(0, 100.0));
+}
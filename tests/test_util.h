@@ -0,0 +1,118 @@
+#pragma once
+
+#include <mlp/mlp.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Models and data sets shared by the tests and the benchmarks. Every factory
+// seeds its own random numbers, so the same arguments give the same result.
+namespace test_util {
+
+// Relu between the layers and softmax on the output, unless activations
+// names one per layer, and the square loss.
+inline mlp::MultilayerPerceptron MakeModel(
+    const std::vector<ssize_t>& dimensions, unsigned seed,
+    std::vector<std::string> activations = {}) {
+  if (activations.empty()) {
+    activations.assign(dimensions.size() - 2, "relu");
+    activations.push_back("softmax");
+  }
+
+  mlp::ActivationFunctionsList act_list;
+  std::vector<mlp::ActivationFunction> act_funcs;
+  for (const auto& name : activations) {
+    act_funcs.push_back(act_list.GetByName(name));
+  }
+
+  std::srand(seed);
+  return mlp::MultilayerPerceptron(
+      dimensions, act_funcs, mlp::LossFunctionsList().GetByName("square"));
+}
+
+// features in [-1, 1], sample i of class i % num_of_classes
+inline void MakeDataSet(size_t size, size_t num_of_features,
+                        size_t num_of_classes, unsigned seed,
+                        mlp::DataSet& input, mlp::DataSet& output) {
+  std::srand(seed);
+  input.clear();
+  output.clear();
+  for (size_t i = 0; i < size; ++i) {
+    mlp::Vector x = mlp::Vector::Random(static_cast<ssize_t>(num_of_features));
+    input.emplace_back(x.data(), x.data() + x.size());
+    output.emplace_back(num_of_classes, 0.0);
+    output.back()[i % num_of_classes] = 1.0;
+  }
+}
+
+// copies of num_of_classes random prototypes with uniform noise of the given
+// amplitude, sample i of class i % num_of_classes
+inline void MakePrototypeDataSet(size_t size, size_t num_of_features,
+                                 size_t num_of_classes, double noise,
+                                 unsigned seed, mlp::DataSet& input,
+                                 mlp::DataSet& output) {
+  std::srand(seed);
+  mlp::Matrix prototypes =
+      mlp::Matrix::Random(static_cast<ssize_t>(num_of_features),
+                          static_cast<ssize_t>(num_of_classes));
+  input.clear();
+  output.clear();
+  for (size_t i = 0; i < size; ++i) {
+    size_t c = i % num_of_classes;
+    mlp::Vector x =
+        prototypes.col(static_cast<ssize_t>(c)) +
+        noise * mlp::Vector::Random(static_cast<ssize_t>(num_of_features));
+    input.emplace_back(x.data(), x.data() + x.size());
+    output.emplace_back(num_of_classes, 0.0);
+    output.back()[c] = 1.0;
+  }
+}
+
+// two classes split by the sign of the first feature
+inline void MakeSeparableDataSet(size_t size, size_t num_of_features,
+                                 unsigned seed, mlp::DataSet& input,
+                                 mlp::DataSet& output) {
+  std::srand(seed);
+  input.clear();
+  output.clear();
+  for (size_t i = 0; i < size; ++i) {
+    mlp::Vector x = mlp::Vector::Random(static_cast<ssize_t>(num_of_features));
+    input.emplace_back(x.data(), x.data() + x.size());
+    output.emplace_back(2, 0.0);
+    output.back()[x[0] > 0.0 ? 1 : 0] = 1.0;
+  }
+}
+
+// Digit-like pixels in [0, 1]: sparse random prototypes with gaussian noise,
+// sample i of class i % num_of_classes.
+inline void MakePixelDataSet(size_t size, size_t num_of_features,
+                             size_t num_of_classes, unsigned seed,
+                             mlp::DataSet& input, mlp::DataSet& output) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> pixel(0.0, 1.0);
+  std::normal_distribution<double> noise(0.0, 0.2);
+
+  mlp::DataSet prototypes(num_of_classes,
+                          std::vector<double>(num_of_features));
+  for (auto& prototype : prototypes) {
+    for (auto& p : prototype) {
+      p = pixel(gen) < 0.2 ? pixel(gen) : 0.0;
+    }
+  }
+
+  input.resize(size);
+  output.assign(size, std::vector<double>(num_of_classes, 0.0));
+  for (size_t i = 0; i < size; ++i) {
+    size_t label = i % num_of_classes;
+    input[i] = prototypes[label];
+    for (auto& p : input[i]) {
+      p = std::min(1.0, std::max(0.0, p + noise(gen)));
+    }
+    output[i][label] = 1.0;
+  }
+}
+
+}  // namespace test_util
@@ -0,0 +1,47 @@
+#include <mlp/codegen.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+
+// Generates a self-contained C++ header with a shape-specialized predict()
+// from a model saved with SaveModel.
+//
+// Usage: mlp-codegen --model <file> --output <header>
+//                    [--namespace mlp_model] [--max-unrolled-weights 4096]
+
+int main(int argc, char** argv) {
+  std::map<std::string, std::string> args;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    args[argv[i]] = argv[i + 1];
+  }
+
+  if (!args.count("--model") || !args.count("--output")) {
+    std::cerr << "Usage: " << argv[0]
+              << " --model <file> --output <header> [--namespace <name>]"
+                 " [--max-unrolled-weights <num>]"
+              << std::endl;
+    return 1;
+  }
+
+  mlp::CodegenOptions options;
+  if (args.count("--namespace")) {
+    options.name_space = args["--namespace"];
+  }
+  if (args.count("--max-unrolled-weights")) {
+    options.max_unrolled_weights = std::stoul(args["--max-unrolled-weights"]);
+  }
+
+  mlp::MultilayerPerceptron model;
+  if (!model.LoadModel(args["--model"], mlp::ActivationFunctionsList(),
+                       mlp::LossFunctionsList())) {
+    std::cerr << "Can't read model " << args["--model"] << std::endl;
+    return 1;
+  }
+
+  if (!mlp::GenerateModelHeader(args["--output"], model, options)) {
+    std::cerr << "Can't generate " << args["--output"] << std::endl;
+    return 1;
+  }
+  return 0;
+}
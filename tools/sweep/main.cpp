@@ -0,0 +1,129 @@
+#include <mlp/sweep.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Hyperparameter sweep over MNIST-like IDX data.
+//
+// Usage: mlp-sweep --train-images <idx3> --train-labels <idx1>
+//                  [--validation-images <idx3> --validation-labels <idx1>]
+//                  [--hidden 16;32,16] [--activations relu,sigmoid]
+//                  [--batch-sizes 50,200] [--iterations 5]
+//                  [--random <num_of_trials>] [--seed <seed>]
+//                  [--threads <num>] [--no-prune]
+//                  [--table results.tsv] [--model best_model]
+//
+// Without validation files the last 10% of the training set is used.
+
+enum { NUM_OF_CLASSES = 10 };
+
+std::vector<std::string> Split(const std::string& s, char delimiter) {
+  std::vector<std::string> parts;
+  std::stringstream stream(s);
+  std::string part;
+  while (std::getline(stream, part, delimiter)) {
+    if (!part.empty()) {
+      parts.push_back(part);
+    }
+  }
+  return parts;
+}
+
+int main(int argc, char** argv) {
+  std::map<std::string, std::string> args = {
+      {"--hidden", "16;32,16"},
+      {"--activations", "relu,sigmoid"},
+      {"--batch-sizes", "50,200"},
+      {"--iterations", "5"},
+      {"--seed", "0"},
+      {"--threads", "0"},
+      {"--table", "sweep_results.tsv"},
+      {"--model", "best_model"},
+  };
+  bool prune = true;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string key = argv[i];
+    if (key == "--no-prune") {
+      prune = false;
+    } else if (i + 1 < argc) {
+      args[key] = argv[++i];
+    } else {
+      std::cerr << "Missing value for " << key << std::endl;
+      return 1;
+    }
+  }
+
+  if (!args.count("--train-images") || !args.count("--train-labels")) {
+    std::cerr << "--train-images and --train-labels are required" << std::endl;
+    return 1;
+  }
+
+  auto train_input = std::make_shared<mlp::DataSet>(
+      mlp::ReadIdxImages(args["--train-images"]));
+  auto train_output = std::make_shared<mlp::DataSet>(mlp::LabelsToDataSet(
+      mlp::ReadIdxLabels(args["--train-labels"]), NUM_OF_CLASSES));
+
+  if (train_input->empty() || train_input->size() != train_output->size()) {
+    std::cerr << "Can't read training set" << std::endl;
+    return 1;
+  }
+
+  auto validation_input = std::make_shared<mlp::DataSet>();
+  auto validation_output = std::make_shared<mlp::DataSet>();
+  if (args.count("--validation-images")) {
+    *validation_input = mlp::ReadIdxImages(args["--validation-images"]);
+    *validation_output = mlp::LabelsToDataSet(
+        mlp::ReadIdxLabels(args["--validation-labels"]), NUM_OF_CLASSES);
+  } else {
+    size_t split = train_input->size() - train_input->size() / 10;
+    validation_input->assign(train_input->begin() + split, train_input->end());
+    validation_output->assign(train_output->begin() + split,
+                              train_output->end());
+    train_input->resize(split);
+    train_output->resize(split);
+  }
+
+  if (validation_input->empty() ||
+      validation_input->size() != validation_output->size()) {
+    std::cerr << "Can't read validation set" << std::endl;
+    return 1;
+  }
+
+  mlp::SweepSpec spec;
+  for (const auto& layers : Split(args["--hidden"], ';')) {
+    std::vector<ssize_t> hidden;
+    for (const auto& size : Split(layers, ',')) {
+      hidden.push_back(std::stol(size));
+    }
+    spec.hidden_layers.push_back(hidden);
+  }
+  spec.activations = Split(args["--activations"], ',');
+  for (const auto& size : Split(args["--batch-sizes"], ',')) {
+    spec.batch_sizes.push_back(std::stoul(size));
+  }
+  spec.num_of_iterations = std::stoul(args["--iterations"]);
+  if (args.count("--random")) {
+    spec.search = mlp::SweepSpec::Search::kRandom;
+    spec.num_of_trials = std::stoul(args["--random"]);
+  }
+  spec.seed = static_cast<unsigned>(std::stoul(args["--seed"]));
+  spec.num_of_threads = std::stoul(args["--threads"]);
+  spec.prune = prune;
+
+  mlp::SweepRunner runner(train_input, train_output, validation_input,
+                          validation_output);
+  std::vector<mlp::TrialResult> results = runner.Run(spec);
+
+  mlp::WriteSweepResults(std::cout, results);
+
+  std::ofstream table(args["--table"]);
+  mlp::WriteSweepResults(table, results);
+
+  runner.GetBestModel().SaveModel(args["--model"]);
+  std::cout << "Best model saved to " << args["--model"] << std::endl;
+}